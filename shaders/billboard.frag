@@ -7,7 +7,7 @@ layout (location = 1) flat in int textureIndex;
 
 layout (location = 0) out vec4 fragColor;
 
-layout (binding = 1) uniform sampler2D textures[];
+layout (set = 1, binding = 0) uniform sampler2D textures[];
 
 void main()
 {
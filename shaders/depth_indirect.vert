@@ -0,0 +1,33 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : enable
+
+#include "types.glsl"
+
+layout (binding = 0) readonly buffer Vertices
+{
+    Vertex vertices[];
+};
+
+layout (binding = 1) readonly buffer Instances
+{
+    Instance instances[];
+};
+
+// instance index of every gl_InstanceIndex, each draw's range starts at its firstInstance
+layout (binding = 2) readonly buffer DrawInstances
+{
+    uint drawInstances[];
+};
+
+layout (push_constant) uniform PushConstant
+{
+    mat4 viewProjection;
+} push;
+
+void main()
+{
+    Vertex vertex = vertices[gl_VertexIndex];
+
+    gl_Position = push.viewProjection * instances[drawInstances[gl_InstanceIndex]].model * vec4(vertex.pos, 1.0);
+}
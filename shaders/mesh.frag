@@ -23,17 +23,14 @@ layout (binding = 3) readonly buffer LightData
     Light lights[];
 };
 
-layout (binding = 4) uniform sampler2D textures[];
-
-layout (push_constant) uniform PushConstant
-{
-    mat4 model;
-    int materialIndex;
-} push;
+// bindless texture table, material and shadow map indices are its slots
+layout (set = 1, binding = 0) uniform sampler2D textures[];
 
 layout (location = 0) in vec3 inNormal;
 layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inWorldPos;
+// from the push constant or the instance, depending on the vertex shader
+layout (location = 3) flat in int inMaterialIndex;
 
 layout (location = 0) out vec4 fragColor;
 
@@ -46,8 +43,8 @@ void main()
     vec3 emissive = vec3(0.0);
     vec3 normal = inNormal;
 
-    if (push.materialIndex > -1) {
-        Material material = materials[push.materialIndex];
+    if (inMaterialIndex > -1) {
+        Material material = materials[inMaterialIndex];
 
         albedo = material.albedoFactor.rgb;
         if (material.albedoTexture > -1)
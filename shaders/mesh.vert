@@ -26,6 +26,7 @@ layout (push_constant) uniform PushConstant
 layout (location = 0) out vec3 outNormal;
 layout (location = 1) out vec2 outUV;
 layout (location = 2) out vec3 outWorldPos;
+layout (location = 3) flat out int outMaterialIndex;
 
 void main()
 {
@@ -37,4 +38,5 @@ void main()
     outNormal = normalize(vertex.normal);
     outUV = vertex.uv;
     outWorldPos = vec3(worldPos);
+    outMaterialIndex = push.materialIndex;
 }
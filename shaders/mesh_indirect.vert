@@ -0,0 +1,48 @@
+#version 450
+
+#extension GL_GOOGLE_include_directive : enable
+
+#include "types.glsl"
+
+layout (binding = 0) readonly buffer Vertices
+{
+    Vertex vertices[];
+};
+
+layout (binding = 1) uniform UBO
+{
+    mat4 projection;
+    mat4 view;
+    uint numLights;
+    vec3 cameraPos;
+} ubo;
+
+layout (binding = 4) readonly buffer Instances
+{
+    Instance instances[];
+};
+
+// instance index of every gl_InstanceIndex, each draw's range starts at its firstInstance
+layout (binding = 5) readonly buffer DrawInstances
+{
+    uint drawInstances[];
+};
+
+layout (location = 0) out vec3 outNormal;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec3 outWorldPos;
+layout (location = 3) flat out int outMaterialIndex;
+
+void main()
+{
+    Vertex vertex = vertices[gl_VertexIndex];
+    Instance instance = instances[drawInstances[gl_InstanceIndex]];
+
+    vec4 worldPos = instance.model * vec4(vertex.pos, 1.0);
+    gl_Position = ubo.projection * ubo.view * worldPos;
+
+    outNormal = normalize(vertex.normal);
+    outUV = vertex.uv;
+    outWorldPos = vec3(worldPos);
+    outMaterialIndex = instance.materialIndex;
+}
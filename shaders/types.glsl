@@ -24,3 +24,31 @@ struct Vertex
     vec2 uv;
     vec3 normal;
 };
+
+struct Instance
+{
+    mat4 model;
+    uint meshIndex;
+    int materialIndex;
+    // stable over frames, indexes the occlusion culling visibility
+    uint visibilityIndex;
+    // instanced draw of the instance, per view
+    uint drawIndex;
+};
+
+struct MeshData
+{
+    vec4 sphere;
+    uint firstIndex;
+    uint indexCount;
+};
+
+// VkDrawIndexedIndirectCommand
+struct DrawCommand
+{
+    uint indexCount;
+    uint instanceCount;
+    uint firstIndex;
+    int vertexOffset;
+    uint firstInstance;
+};
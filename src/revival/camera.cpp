@@ -1,30 +1,36 @@
 #include <revival/camera.h>
+#include <revival/profiler.h>
 #include "imgui.h"
 
 void Camera::update(GLFWwindow *window, float deltaTime)
 {
-    // keyboard
-    keys.shift = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) != GLFW_RELEASE;
-    keys.left = glfwGetKey(window, GLFW_KEY_A) != GLFW_RELEASE;
-    keys.right = glfwGetKey(window, GLFW_KEY_D) != GLFW_RELEASE;
-    keys.up = glfwGetKey(window, GLFW_KEY_W) != GLFW_RELEASE;
-    keys.down = glfwGetKey(window, GLFW_KEY_S) != GLFW_RELEASE;
+    PROFILE_FUNCTION();
 
-    // mouse
-    double xpos, ypos;
-    glfwGetCursorPos(window, &xpos, &ypos);
+    // no input without window (headless), only the view is updated
+    if (window) {
+        // keyboard
+        keys.shift = glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) != GLFW_RELEASE;
+        keys.left = glfwGetKey(window, GLFW_KEY_A) != GLFW_RELEASE;
+        keys.right = glfwGetKey(window, GLFW_KEY_D) != GLFW_RELEASE;
+        keys.up = glfwGetKey(window, GLFW_KEY_W) != GLFW_RELEASE;
+        keys.down = glfwGetKey(window, GLFW_KEY_S) != GLFW_RELEASE;
 
-    if (!ImGui::GetIO().WantCaptureMouse && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT)) {
-        vec2 motion = vec2(xpos - cursorPrevious.x, ypos - cursorPrevious.y);
+        // mouse
+        double xpos, ypos;
+        glfwGetCursorPos(window, &xpos, &ypos);
 
-        yaw += motion.x * rotationSpeed;
-        pitch -= motion.y * rotationSpeed;
+        if (!ImGui::GetIO().WantCaptureMouse && glfwGetMouseButton(window, GLFW_MOUSE_BUTTON_LEFT)) {
+            vec2 motion = vec2(xpos - cursorPrevious.x, ypos - cursorPrevious.y);
 
-        pitch = glm::clamp(pitch, -89.9f, 89.9f);
-    }
+            yaw += motion.x * rotationSpeed;
+            pitch -= motion.y * rotationSpeed;
+
+            pitch = glm::clamp(pitch, -89.9f, 89.9f);
+        }
 
-    cursorPrevious.x = xpos;
-    cursorPrevious.y = ypos;
+        cursorPrevious.x = xpos;
+        cursorPrevious.y = ypos;
+    }
 
     float speedBoost = 1.0f;
     if (keys.shift)
@@ -0,0 +1,53 @@
+#include <revival/draw_list.h>
+#include <revival/profiler.h>
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+uint64_t DrawList::makeKey(uint32_t pass, uint32_t pipeline, int materialIndex, float depth)
+{
+    assert(pass < (1 << 4) && pipeline < (1 << 8) && materialIndex + 1 < (1 << 20));
+
+    // bits of a non-negative float sort like the float
+    uint32_t depthBits;
+    depth = std::max(depth, 0.0f);
+    memcpy(&depthBits, &depth, sizeof(depthBits));
+
+    if (pass == DRAW_PASS_TRANSPARENT)
+        depthBits = ~depthBits;
+
+    return uint64_t(pass) << 60 | uint64_t(pipeline) << 52 | uint64_t(materialIndex + 1) << 32 | depthBits;
+}
+
+void DrawList::sort()
+{
+    PROFILE_FUNCTION();
+
+    if (items.size() < 2) return;
+
+    // histograms of all eight bytes in one pass
+    uint32_t counts[8][256] = {};
+    for (auto &item : items) {
+        for (int byte = 0; byte < 8; byte++)
+            counts[byte][(item.key >> (byte * 8)) & 0xff]++;
+    }
+
+    scratch.resize(items.size());
+    for (int byte = 0; byte < 8; byte++) {
+        // every key has the same value in this byte
+        if (counts[byte][(items[0].key >> (byte * 8)) & 0xff] == items.size())
+            continue;
+
+        uint32_t offsets[256];
+        uint32_t offset = 0;
+        for (int i = 0; i < 256; i++) {
+            offsets[i] = offset;
+            offset += counts[byte][i];
+        }
+
+        for (auto &item : items)
+            scratch[offsets[(item.key >> (byte * 8)) & 0xff]++] = item;
+
+        items.swap(scratch);
+    }
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <revival/types.h>
+#include <climits>
+#include <vector>
+
+struct GameObject;
+
+// first field of the sort key, later passes draw after earlier ones
+const uint32_t DRAW_PASS_OPAQUE = 0;
+const uint32_t DRAW_PASS_TRANSPARENT = 1;
+
+struct DrawItem
+{
+    uint64_t key;
+    // into whatever the list was built from
+    uint32_t index;
+};
+
+// Draws sorted by a 64 bit key, most significant first:
+//   pass (4 bits) | pipeline (8) | material index + 1 (20) | quantized depth (32)
+// so state changes only between runs of the same pipeline and material, and every run is in depth order.
+class DrawList
+{
+public:
+    // opaque draws go front to back for early-Z, transparent ones back to front. Depth is clamped to 0.
+    static uint64_t makeKey(uint32_t pass, uint32_t pipeline, int materialIndex, float depth);
+
+    void clear() { items.clear(); };
+    void add(uint64_t key, uint32_t index) { items.push_back({key, index}); };
+
+    // stable LSD radix sort, bytes that are equal in every key are skipped
+    void sort();
+
+    std::vector<DrawItem> &getItems() { return items; };
+private:
+    std::vector<DrawItem> items;
+    std::vector<DrawItem> scratch;
+};
+
+// last state recorded into a command buffer, passes skip updates that would not change it
+struct DrawState
+{
+    const GameObject *gameObject = nullptr;
+    int materialIndex = INT_MIN;
+
+    // per frame
+    uint32_t draws = 0;
+    uint32_t binds = 0;
+    uint32_t pushConstants = 0;
+    uint32_t skippedPushConstants = 0;
+
+    // for a new command buffer, nothing pushed yet
+    void reset() { gameObject = nullptr; materialIndex = INT_MIN; };
+};
@@ -1,52 +1,63 @@
 #include <revival/engine.h>
 #include <revival/fs.h>
+#include <revival/profiler.h>
 #include <stdio.h>
 #include <time.h>
 
-bool Engine::init(const char *name, int width, int height, bool enableFullScreen)
+bool Engine::init(const char *name, int width, int height, bool enableFullScreen, GraphicsSettings graphicsSettings)
 {
     windowName = name;
     windowWidth = width;
     windowHeight = height;
+    headless = graphicsSettings.headless;
+
+    profiler::registerThread("Main");
 
     // change current directory from build/ to a project root
     std::filesystem::current_path(fs::getProjectRoot());
 
     srand(time(0));
 
-    if (!glfwInit()) {
-        printf("Failed to initialize glfw.\n");
-        exit(EXIT_FAILURE);
-    }
-
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-
-    if (enableFullScreen) {
-        const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
-        glfwWindowHint(GLFW_RED_BITS, mode->redBits);
-        glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
-        glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
-        glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
-
-        window = glfwCreateWindow(mode->width, mode->height, name, glfwGetPrimaryMonitor(), NULL);
-        windowWidth = mode->width;
-        windowHeight = mode->height;
-        isFullscreen = true;
+    window = nullptr;
+    if (headless) {
+        // no window, no input and no audio device
+        graphicsSettings.width = width;
+        graphicsSettings.height = height;
     } else {
-        window = glfwCreateWindow(windowWidth, windowHeight, name, NULL, NULL);
-        isFullscreen = false;
-    }
-    if (!window) {
-        printf("Failed to create glfw window.\n");
-        glfwTerminate();
-        exit(EXIT_FAILURE);
+        if (!glfwInit()) {
+            printf("Failed to initialize glfw.\n");
+            exit(EXIT_FAILURE);
+        }
+
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+
+        if (enableFullScreen) {
+            const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
+            glfwWindowHint(GLFW_RED_BITS, mode->redBits);
+            glfwWindowHint(GLFW_GREEN_BITS, mode->greenBits);
+            glfwWindowHint(GLFW_BLUE_BITS, mode->blueBits);
+            glfwWindowHint(GLFW_REFRESH_RATE, mode->refreshRate);
+
+            window = glfwCreateWindow(mode->width, mode->height, name, glfwGetPrimaryMonitor(), NULL);
+            windowWidth = mode->width;
+            windowHeight = mode->height;
+            isFullscreen = true;
+        } else {
+            window = glfwCreateWindow(windowWidth, windowHeight, name, NULL, NULL);
+            isFullscreen = false;
+        }
+        if (!window) {
+            printf("Failed to create glfw window.\n");
+            glfwTerminate();
+            exit(EXIT_FAILURE);
+        }
+
+        glfwSetWindowUserPointer(window, this);
+        glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+        glfwSetKeyCallback(window, keyCallback);
+        glfwMakeContextCurrent(window);
     }
 
-    glfwSetWindowUserPointer(window, this);
-    glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
-    glfwSetKeyCallback(window, keyCallback);
-    glfwMakeContextCurrent(window);
-
     sceneManager.addLight({mat4(1.0), vec3(18.0, 19.0, 22.0), vec3(1.0)});
 
     for (int i = 0; i < 10; i++) {
@@ -57,7 +68,7 @@ bool Engine::init(const char *name, int width, int height, bool enableFullScreen
     sceneManager.loadScene("cube", "models/cube.gltf");
     sceneManager.loadScene("plane", "models/plane.gltf");
 
-    if (!renderer.init(window, &camera, &sceneManager, &gameManager, &globals)) {
+    if (!renderer.init(window, &camera, &sceneManager, &gameManager, &globals, graphicsSettings)) {
         printf("Failed to initialize renderer.\n");
         return false;
     }
@@ -67,7 +78,7 @@ bool Engine::init(const char *name, int width, int height, bool enableFullScreen
         return false;
     }
 
-    if (!audioManager.init()) {
+    if (!headless && !audioManager.init()) {
         printf("Failed to initialize audio.\n");
         return false;
     }
@@ -88,24 +99,46 @@ bool Engine::init(const char *name, int width, int height, bool enableFullScreen
 
 void Engine::shutdown()
 {
-    audioManager.shutdown();
+    if (!headless)
+        audioManager.shutdown();
     physics.shutdown(gameManager.getGameObjects());
     renderer.shutdown();
 
-    glfwTerminate();
+    if (!headless)
+        glfwTerminate();
 }
 
-void Engine::run()
+void Engine::run(uint32_t frameCount)
 {
+    if (headless) {
+        // fixed time step, so headless runs are reproducible
+        const double deltaTime = 1.0 / 60.0;
+
+        for (uint32_t frame = 0; frame < frameCount; frame++) {
+            profiler::beginFrame();
+            update(deltaTime);
+            renderer.render();
+        }
+
+        // report gpu timings for benchmarks
+        for (auto &[name, stats] : renderer.getGpuProfiler().getAllStats()) {
+            printf("GPU %s: avg %.3f ms, min %.3f ms, max %.3f ms\n", name.c_str(), stats.average, stats.min, stats.max);
+        }
+        return;
+    }
+
     double previousTime = glfwGetTime();
+    uint32_t frame = 0;
 
     // TEST audio
     // audioManager.playSound("audio/sunny_pierce.mp3");
     // audioManager.playSound("audio/doom.mp3");
 
     running = true;
-    while (!glfwWindowShouldClose(window) && running)
+    while (!glfwWindowShouldClose(window) && running && (frameCount == 0 || frame++ < frameCount))
     {
+        profiler::beginFrame();
+
         double deltaTime = glfwGetTime() - previousTime;
         previousTime = glfwGetTime();
 
@@ -118,8 +151,38 @@ void Engine::run()
     }
 }
 
+bool Engine::saveFrame(const char *path)
+{
+    std::vector<unsigned char> pixels;
+    renderer.getGraphics().readback(pixels);
+
+    VkExtent2D extent = renderer.getGraphics().getSwapchainExtent();
+
+    FILE *file = fopen(path, "wb");
+    if (!file) {
+        printf("Failed to open file for writing - %s\n", path);
+        return false;
+    }
+
+    fprintf(file, "P6\n%u %u\n255\n", extent.width, extent.height);
+
+    // BGRA to RGB
+    std::vector<unsigned char> rgb(extent.width * extent.height * 3);
+    for (size_t i = 0; i < extent.width * extent.height; i++) {
+        rgb[i * 3 + 0] = pixels[i * 4 + 2];
+        rgb[i * 3 + 1] = pixels[i * 4 + 1];
+        rgb[i * 3 + 2] = pixels[i * 4 + 0];
+    }
+    fwrite(rgb.data(), 1, rgb.size(), file);
+    fclose(file);
+
+    return true;
+}
+
 void Engine::update(double deltaTime)
 {
+    PROFILE_FUNCTION();
+
     // snap billboard position to light position
     // sceneManager.getBillboardByIndex(0).position = sceneManager.getLightByIndex(0).position;
 
@@ -132,6 +195,7 @@ void Engine::update(double deltaTime)
     }
 
     physics.update(deltaTime, gameManager.getGameObjects());
+    gameManager.updateBounds();
     camera.update(window, deltaTime);
 }
 
@@ -147,6 +211,11 @@ void Engine::keyCallback(GLFWwindow* window, int key, int scancode, int action,
         engine->globals.showImGui = !engine->globals.showImGui;
     }
 
+    // dump cpu zones of the last PROFILER_HISTORY frames, open in chrome://tracing or ui.perfetto.dev
+    if (glfwGetKey(window, GLFW_KEY_P) == GLFW_PRESS) {
+        profiler::saveChromeTrace("build/cpu_trace.json");
+    }
+
     if (glfwGetKey(window, GLFW_KEY_Q) == GLFW_PRESS) {
         engine->gameManager.createGameObject(engine->physics, "cube", &engine->sceneManager.getSceneByName("cube"), Transform(vec3(0.0f, 50.0f, 0.0f)), vec3(1.0f), false);
     }
@@ -13,9 +13,13 @@
 class Engine
 {
 public:
-    bool init(const char *name, int width, int height, bool isFullscreen = true);
+    bool init(const char *name, int width, int height, bool isFullscreen = true, GraphicsSettings graphicsSettings = {});
     void shutdown();
-    void run();
+    // frameCount 0 runs until the window is closed, headless mode needs a frame count
+    void run(uint32_t frameCount = 0);
+
+    // writes the last rendered frame as binary ppm, headless only
+    bool saveFrame(const char *path);
 private:
     void update(double deltaTime);
     static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods);
@@ -39,4 +43,5 @@ private:
 
     bool running = false;
     bool isFullscreen = false;
+    bool headless = false;
 };
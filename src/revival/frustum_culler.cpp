@@ -0,0 +1,129 @@
+#include <revival/frustum_culler.h>
+#include <revival/job_system.h>
+#include <revival/profiler.h>
+#include <cfloat>
+#include <cstring>
+#include <numeric>
+
+#if defined(__SSE__) || defined(_M_X64)
+#include <xmmintrin.h>
+#define CULL_SSE
+#endif
+
+void FrustumCuller::update(std::vector<GameObject> &gameObjects)
+{
+    PROFILE_FUNCTION();
+
+    objectCount = gameObjects.size();
+    uint32_t paddedCount = (objectCount + 3) & ~3u;
+
+    centerX.resize(paddedCount);
+    centerY.resize(paddedCount);
+    centerZ.resize(paddedCount);
+    radius.resize(paddedCount);
+
+    for (uint32_t i = 0; i < paddedCount; i++) {
+        if (i < objectCount && gameObjects[i].scene) {
+            Sphere &sphere = gameObjects[i].sphere;
+            centerX[i] = sphere.center.x;
+            centerY[i] = sphere.center.y;
+            centerZ[i] = sphere.center.z;
+            radius[i] = sphere.radius;
+        } else {
+            // no plane distance is above FLT_MAX
+            centerX[i] = centerY[i] = centerZ[i] = 0.0f;
+            radius[i] = -FLT_MAX;
+        }
+    }
+}
+
+void FrustumCuller::cull(JobSystem &jobSystem, const std::vector<mat4> &viewProjections)
+{
+    PROFILE_FUNCTION();
+
+    uint32_t groupCount = (objectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE;
+
+    views.resize(viewProjections.size());
+    for (size_t i = 0; i < views.size(); i++) {
+        math::extractFrustumPlanes(viewProjections[i], views[i].planes);
+        views[i].visible.resize(radius.size());
+        views[i].groupCounts.assign(groupCount, 0);
+    }
+
+    // every group tests all views, so its spheres are loaded into cache once
+    jobSystem.dispatch(objectCount, CULL_GROUP_SIZE, [&](uint32_t first, uint32_t last) {
+        PROFILE_SCOPE("Frustum cull group");
+
+        for (auto &view : views)
+            view.groupCounts[first / CULL_GROUP_SIZE] = cullGroup(view, first, last);
+    });
+    jobSystem.wait();
+
+    for (auto &view : views) {
+        uint32_t count = 0;
+        for (uint32_t group = 0; group < groupCount; group++) {
+            uint32_t visibleCount = view.groupCounts[group];
+            // ranges may overlap, the list only ever moves towards the front
+            memmove(view.visible.data() + count, view.visible.data() + group * CULL_GROUP_SIZE, visibleCount * sizeof(uint32_t));
+            count += visibleCount;
+        }
+        view.visible.resize(count);
+    }
+}
+
+void FrustumCuller::cullNone(uint32_t viewCount)
+{
+    views.resize(viewCount);
+    for (auto &view : views) {
+        view.visible.resize(objectCount);
+        std::iota(view.visible.begin(), view.visible.end(), 0);
+    }
+}
+
+uint32_t FrustumCuller::cullGroup(View &view, uint32_t first, uint32_t last)
+{
+    uint32_t *visible = view.visible.data() + first;
+    uint32_t count = 0;
+
+    // a sphere is outside once its center is further than its radius behind any plane
+#ifdef CULL_SSE
+    __m128 planes[6][4];
+    for (int p = 0; p < 6; p++) {
+        for (int c = 0; c < 4; c++)
+            planes[p][c] = _mm_set1_ps(view.planes[p][c]);
+    }
+
+    // groups start at multiples of 4, the last one reads into the padding
+    for (uint32_t i = first; i < last; i += 4) {
+        __m128 x = _mm_loadu_ps(&centerX[i]);
+        __m128 y = _mm_loadu_ps(&centerY[i]);
+        __m128 z = _mm_loadu_ps(&centerZ[i]);
+        __m128 negRadius = _mm_sub_ps(_mm_setzero_ps(), _mm_loadu_ps(&radius[i]));
+
+        int mask = 0xf;
+        for (int p = 0; p < 6 && mask; p++) {
+            __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes[p][0], x), _mm_mul_ps(planes[p][1], y)),
+                                         _mm_add_ps(_mm_mul_ps(planes[p][2], z), planes[p][3]));
+            mask &= _mm_movemask_ps(_mm_cmpgt_ps(distance, negRadius));
+        }
+
+        for (int j = 0; j < 4; j++) {
+            if (mask & (1 << j))
+                visible[count++] = i + j;
+        }
+    }
+#else
+    for (uint32_t i = first; i < last; i++) {
+        bool inside = true;
+        for (int p = 0; p < 6 && inside; p++) {
+            vec4 &plane = view.planes[p];
+            inside = plane.x * centerX[i] + plane.y * centerY[i] + plane.z * centerZ[i] + plane.w > -radius[i];
+        }
+
+        if (inside)
+            visible[count++] = i;
+    }
+#endif
+
+    return count;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <revival/types.h>
+#include <revival/game_object.h>
+#include <vector>
+
+class JobSystem;
+
+// game objects tested by one job, multiple of the SIMD width
+const uint32_t CULL_GROUP_SIZE = 1024;
+
+// CPU frustum culling, of the draws on the recorded path and of the instances written for the GPU driven one. World bounding spheres of the game objects are copied
+// into SoA arrays and tested four at a time against the planes of every view with SSE, groups of objects run on the
+// job system. Every view ends up with a compact list of visible game object indices, in gameObjects order.
+class FrustumCuller
+{
+public:
+    // copies the world spheres, GameManager::updateBounds has to run first. Objects without a scene are never visible.
+    void update(std::vector<GameObject> &gameObjects);
+
+    void cull(JobSystem &jobSystem, const std::vector<mat4> &viewProjections);
+    // every object is visible in every view, to compare against culling
+    void cullNone(uint32_t viewCount);
+
+    std::vector<uint32_t> &getVisible(uint32_t view) { return views[view].visible; };
+    uint32_t getViewCount() { return views.size(); };
+    uint32_t getObjectCount() { return objectCount; };
+private:
+    struct View
+    {
+        vec4 planes[6];
+        // every group writes from its first object on, compacted once all groups finished
+        std::vector<uint32_t> visible;
+        std::vector<uint32_t> groupCounts;
+    };
+
+    uint32_t cullGroup(View &view, uint32_t first, uint32_t last);
+
+    // padded to a multiple of 4 with spheres that are never visible
+    std::vector<float> centerX;
+    std::vector<float> centerY;
+    std::vector<float> centerZ;
+    std::vector<float> radius;
+    uint32_t objectCount = 0;
+
+    std::vector<View> views;
+};
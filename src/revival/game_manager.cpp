@@ -1,4 +1,5 @@
 #include <revival/game_manager.h>
+#include <revival/profiler.h>
 
 void GameManager::createGameObject(Physics &physics, std::string name, Scene *scene, Transform transform, vec3 halfExtent, bool isStatic)
 {
@@ -20,3 +21,16 @@ std::vector<GameObject> &GameManager::getGameObjects()
 {
     return gameObjects;
 }
+
+void GameManager::updateBounds()
+{
+    PROFILE_FUNCTION();
+
+    for (auto &gameObject : gameObjects) {
+        if (!gameObject.scene) continue;
+
+        mat4 model = gameObject.transform.getModelMatrix();
+        gameObject.aabb = math::transform(gameObject.scene->aabb, model);
+        gameObject.sphere = math::transform(gameObject.scene->sphere, model);
+    }
+}
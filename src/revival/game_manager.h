@@ -10,6 +10,9 @@ public:
     GameObject *getGameObjectByName(std::string name);
     std::vector<GameObject> &getGameObjects();
 
+    // moves the scene bounds of every game object into world space, after physics moved them
+    void updateBounds();
+
 private:
     std::vector<GameObject> gameObjects;
     std::unordered_map<std::string, GameObject*> gameObjectsMap;
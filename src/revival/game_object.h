@@ -12,4 +12,8 @@ struct GameObject
 
     Scene *scene;
     RigidBody rigidBody;
+
+    // world space bounds of the scene, updated once per frame by GameManager::updateBounds
+    AABB aabb;
+    Sphere sphere;
 };
@@ -0,0 +1,67 @@
+#include <revival/instance_batcher.h>
+#include <revival/profiler.h>
+#include <algorithm>
+#include <cfloat>
+
+void InstanceBatcher::begin(Buffer &instanceBuffer, Buffer *drawInstanceBuffer, uint32_t bufferCapacity)
+{
+    instances = static_cast<InstanceData*>(instanceBuffer.info.pMappedData);
+    drawInstances = drawInstanceBuffer ? static_cast<uint32_t*>(drawInstanceBuffer->info.pMappedData) : nullptr;
+    capacity = bufferCapacity;
+    instanceCount = 0;
+    instanceObjects.clear();
+}
+
+void InstanceBatcher::build(std::vector<GameObject> &gameObjects, const std::vector<uint32_t> &indices, vec3 eye, std::vector<InstanceBatch> &batches)
+{
+    PROFILE_FUNCTION();
+
+    batches.clear();
+
+    // objects of the same scene next to each other, in their original order
+    sorted.assign(indices.begin(), indices.end());
+    std::stable_sort(sorted.begin(), sorted.end(), [&](uint32_t a, uint32_t b) {
+        return gameObjects[a].scene < gameObjects[b].scene;
+    });
+
+    size_t begin = 0;
+    while (begin < sorted.size()) {
+        Scene *scene = gameObjects[sorted[begin]].scene;
+
+        size_t end = begin + 1;
+        while (end < sorted.size() && gameObjects[sorted[end]].scene == scene)
+            end++;
+
+        if (scene) {
+            models.clear();
+            float depth = FLT_MAX;
+            for (size_t i = begin; i < end; i++) {
+                GameObject &gameObject = gameObjects[sorted[i]];
+                models.push_back(gameObject.transform.getModelMatrix());
+                depth = std::min(depth, glm::length(gameObject.sphere.center - eye) - gameObject.sphere.radius);
+            }
+
+            for (const Mesh &mesh : scene->meshes) {
+                uint32_t count = std::min<uint32_t>(models.size(), capacity - instanceCount);
+                if (count == 0) return;
+
+                batches.push_back({&mesh, instanceCount, count, depth});
+                for (uint32_t i = 0; i < count; i++) {
+                    if (drawInstances)
+                        drawInstances[instanceCount] = instanceCount;
+                    instanceObjects.push_back(sorted[begin + i]);
+
+                    InstanceData &instance = instances[instanceCount++];
+                    instance.model = models[i] * mesh.matrix;
+                    // filled in by GPU culling
+                    instance.meshIndex = 0;
+                    instance.materialIndex = mesh.materialIndex;
+                    instance.visibilityIndex = 0;
+                    instance.drawIndex = 0;
+                }
+            }
+        }
+
+        begin = end;
+    }
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <revival/types.h>
+#include <revival/game_object.h>
+#include <vector>
+
+// Groups game objects that share a scene into instanced draws. Every batch is one mesh of one scene, with the model
+// matrices of all its game objects at consecutive indices of the per frame instance buffer. The passes' instanced
+// pipelines find them through the draw instance buffer at gl_InstanceIndex, which the recorded path fills with the
+// identity and GPU culling with the visible instances of each draw.
+class InstanceBatcher
+{
+public:
+    // instances are written to the mapped buffer from its start, capacity in InstanceData.
+    // With drawInstanceBuffer every instance index is written to the same position of it as well
+    void begin(Buffer &instanceBuffer, Buffer *drawInstanceBuffer, uint32_t capacity);
+
+    // batches of the objects at indices, instances over the capacity are not drawn
+    void build(std::vector<GameObject> &gameObjects, const std::vector<uint32_t> &indices, vec3 eye, std::vector<InstanceBatch> &batches);
+
+    uint32_t getInstanceCount() { return instanceCount; };
+    // game object index of every instance written since begin
+    std::vector<uint32_t> &getInstanceObjects() { return instanceObjects; };
+private:
+    InstanceData *instances = nullptr;
+    uint32_t *drawInstances = nullptr;
+    uint32_t capacity = 0;
+    uint32_t instanceCount = 0;
+
+    // scratch, kept between frames
+    std::vector<uint32_t> sorted;
+    std::vector<mat4> models;
+    std::vector<uint32_t> instanceObjects;
+};
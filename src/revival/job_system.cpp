@@ -0,0 +1,114 @@
+#include <revival/job_system.h>
+#include <revival/profiler.h>
+#include <string>
+#include <algorithm>
+
+static thread_local uint32_t currentThreadIndex = 0;
+
+void JobSystem::init(uint32_t threadCount)
+{
+    if (threadCount == 0) {
+        uint32_t hardwareThreads = std::thread::hardware_concurrency();
+        threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+    }
+
+    running = true;
+
+    for (uint32_t i = 0; i < threadCount; i++) {
+        workers.emplace_back(&JobSystem::workerLoop, this, i + 1);
+    }
+}
+
+void JobSystem::shutdown()
+{
+    wait();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeCondition.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+
+    workers.clear();
+}
+
+void JobSystem::execute(std::function<void()> job)
+{
+    pendingJobs.fetch_add(1);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(std::move(job));
+    }
+    wakeCondition.notify_one();
+}
+
+void JobSystem::dispatch(uint32_t count, uint32_t groupSize, std::function<void(uint32_t begin, uint32_t end)> func)
+{
+    if (count == 0 || groupSize == 0) return;
+
+    for (uint32_t begin = 0; begin < count; begin += groupSize) {
+        uint32_t end = std::min(begin + groupSize, count);
+        execute([func, begin, end]() {
+            func(begin, end);
+        });
+    }
+}
+
+void JobSystem::wait()
+{
+    while (pendingJobs.load() > 0) {
+        if (!runNextJob())
+            std::this_thread::yield();
+    }
+}
+
+uint32_t JobSystem::getThreadIndex()
+{
+    return currentThreadIndex;
+}
+
+void JobSystem::workerLoop(uint32_t threadIndex)
+{
+    currentThreadIndex = threadIndex;
+    profiler::registerThread(("Worker " + std::to_string(threadIndex)).c_str());
+
+    while (true) {
+        std::function<void()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeCondition.wait(lock, [this] { return !jobs.empty() || !running; });
+
+            if (!running && jobs.empty())
+                return;
+
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+
+        job();
+        pendingJobs.fetch_sub(1);
+    }
+}
+
+bool JobSystem::runNextJob()
+{
+    std::function<void()> job;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (jobs.empty())
+            return false;
+
+        job = std::move(jobs.front());
+        jobs.pop_front();
+    }
+
+    job();
+    pendingJobs.fetch_sub(1);
+    return true;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Simple fixed size worker pool for engine side work (pipeline compilation, culling, command recording).
+// Physics keeps its own Jolt thread pool.
+class JobSystem
+{
+public:
+    // threadCount 0 means one worker per hardware thread minus the main thread
+    void init(uint32_t threadCount = 0);
+    void shutdown();
+
+    void execute(std::function<void()> job);
+
+    // splits [0, count) into groups of groupSize and runs them on the pool, func receives [begin, end)
+    void dispatch(uint32_t count, uint32_t groupSize, std::function<void(uint32_t begin, uint32_t end)> func);
+
+    // blocks until every queued job is finished, the calling thread helps with the work meanwhile
+    void wait();
+    bool isBusy() { return pendingJobs.load() > 0; };
+
+    // workers + main thread
+    uint32_t getThreadCount() { return static_cast<uint32_t>(workers.size()) + 1; };
+    // 0 for the main (or any non worker) thread, 1..N for workers
+    static uint32_t getThreadIndex();
+private:
+    void workerLoop(uint32_t threadIndex);
+    bool runNextJob();
+
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> jobs;
+    std::mutex mutex;
+    std::condition_variable wakeCondition;
+    std::atomic<uint32_t> pendingJobs = 0;
+    bool running = false;
+};
@@ -1,14 +1,68 @@
 #include <revival/engine.h>
+#include <string.h>
 
-int main()
+int main(int argc, char **argv)
 {
+    GraphicsSettings graphicsSettings;
+    int width = 1280, height = 720;
+    uint32_t frameCount = 0;
+    const char *outputPath = nullptr;
+
+    // --headless [--frames N] [--width W] [--height H] [--output frame.ppm]
+    // --present-mode fifo|relaxed|mailbox|immediate, --uncapped, --image-count N
+    // --device index|name
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            graphicsSettings.headless = true;
+        } else if (strcmp(argv[i], "--uncapped") == 0) {
+            // no vsync, for measuring throughput
+            graphicsSettings.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+        } else if (strcmp(argv[i], "--present-mode") == 0 && i + 1 < argc) {
+            const char *mode = argv[++i];
+            if (strcmp(mode, "fifo") == 0)
+                graphicsSettings.presentMode = VK_PRESENT_MODE_FIFO_KHR;
+            else if (strcmp(mode, "relaxed") == 0)
+                graphicsSettings.presentMode = VK_PRESENT_MODE_FIFO_RELAXED_KHR;
+            else if (strcmp(mode, "mailbox") == 0)
+                graphicsSettings.presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+            else if (strcmp(mode, "immediate") == 0)
+                graphicsSettings.presentMode = VK_PRESENT_MODE_IMMEDIATE_KHR;
+            else
+                printf("Unknown present mode: %s\n", mode);
+        } else if (strcmp(argv[i], "--image-count") == 0 && i + 1 < argc) {
+            graphicsSettings.imageCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--device") == 0 && i + 1 < argc) {
+            const char *device = argv[++i];
+            if (strspn(device, "0123456789") == strlen(device))
+                graphicsSettings.deviceIndex = atoi(device);
+            else
+                graphicsSettings.deviceName = device;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frameCount = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--width") == 0 && i + 1 < argc) {
+            width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--height") == 0 && i + 1 < argc) {
+            height = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else {
+            printf("Unknown argument: %s\n", argv[i]);
+        }
+    }
+
+    if (graphicsSettings.headless && frameCount == 0)
+        frameCount = 100;
+
     Engine engine;
-    if (!engine.init("Game", 1280, 720, false)) {
+    if (!engine.init("Game", width, height, false, graphicsSettings)) {
         printf("Failed to initialize engine.\n");
         return EXIT_FAILURE;
     }
 
-    engine.run();
+    engine.run(frameCount);
+
+    if (outputPath && graphicsSettings.headless)
+        engine.saveFrame(outputPath);
 
     engine.shutdown();
     return 0;
@@ -1,4 +1,17 @@
 #include <revival/math/math.h>
+#include <algorithm>
+
+void AABB::extend(vec3 point)
+{
+    min = glm::min(min, point);
+    max = glm::max(max, point);
+}
+
+void AABB::extend(const AABB &other)
+{
+    min = glm::min(min, other.min);
+    max = glm::max(max, other.max);
+}
 
 namespace math
 {
@@ -30,4 +43,55 @@ mat4 perspectiveInf(float fov, float aspectRatio, float near)
     );
 }
 
+void extractFrustumPlanes(const mat4 &m, vec4 planes[6])
+{
+    // Gribb/Hartmann, rows of the (column-major) matrix
+    vec4 row0 = vec4(m[0][0], m[1][0], m[2][0], m[3][0]);
+    vec4 row1 = vec4(m[0][1], m[1][1], m[2][1], m[3][1]);
+    vec4 row2 = vec4(m[0][2], m[1][2], m[2][2], m[3][2]);
+    vec4 row3 = vec4(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = row3 + row0;
+    planes[1] = row3 - row0;
+    planes[2] = row3 + row1;
+    planes[3] = row3 - row1;
+    // reversed depth only swaps which of these two is the near plane
+    planes[4] = row2;
+    planes[5] = row3 - row2;
+
+    for (int i = 0; i < 6; i++) {
+        float length = glm::length(vec3(planes[i]));
+        if (length > 0.0f)
+            planes[i] /= length;
+    }
+}
+
+AABB transform(const AABB &aabb, const mat4 &m)
+{
+    if (aabb.isEmpty())
+        return aabb;
+
+    // Arvo, the half extent is projected onto the absolute axes of m
+    vec3 center = vec3(m * vec4(aabb.getCenter(), 1.0f));
+    mat3 axes = mat3(m);
+    vec3 extent = glm::abs(axes[0]) * aabb.getHalfExtent().x
+                + glm::abs(axes[1]) * aabb.getHalfExtent().y
+                + glm::abs(axes[2]) * aabb.getHalfExtent().z;
+
+    AABB result;
+    result.min = center - extent;
+    result.max = center + extent;
+    return result;
+}
+
+Sphere transform(const Sphere &sphere, const mat4 &m)
+{
+    float scale = std::max({glm::length(vec3(m[0])), glm::length(vec3(m[1])), glm::length(vec3(m[2]))});
+
+    Sphere result;
+    result.center = vec3(m * vec4(sphere.center, 1.0f));
+    result.radius = sphere.radius * scale;
+    return result;
+}
+
 } // namespace math
@@ -13,6 +13,7 @@
 #include <glm/gtx/transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/integer.hpp>
+#include <cfloat>
 
 using glm::vec2;
 using glm::vec3;
@@ -22,10 +23,39 @@ using glm::mat3;
 using glm::mat4;
 using glm::quat;
 
+// empty until extended, min > max
+struct AABB
+{
+    vec3 min = vec3(FLT_MAX);
+    vec3 max = vec3(-FLT_MAX);
+
+    void extend(vec3 point);
+    void extend(const AABB &other);
+
+    bool isEmpty() const { return min.x > max.x; };
+    vec3 getCenter() const { return (min + max) * 0.5f; };
+    vec3 getHalfExtent() const { return (max - min) * 0.5f; };
+};
+
+struct Sphere
+{
+    vec3 center = vec3(0.0f);
+    float radius = 0.0f;
+};
+
 namespace math
 {
 
 mat4 perspective(float fov, float aspectRatio, float near, float far);
 mat4 perspectiveInf(float fov, float aspectRatio, float near);
 
+// left, right, bottom, top, near, far planes of a clip space with 0..1 depth, as (normal, distance) with normals pointing inside.
+// Planes at infinity (infinite perspective) are left unnormalized with a zero normal, so every point is inside them.
+void extractFrustumPlanes(const mat4 &viewProjection, vec4 planes[6]);
+
+// box around the transformed box, so it only grows under rotation
+AABB transform(const AABB &aabb, const mat4 &m);
+// radius scaled by the largest axis scale of m
+Sphere transform(const Sphere &sphere, const mat4 &m);
+
 } // namespace math
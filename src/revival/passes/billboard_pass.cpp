@@ -4,12 +4,14 @@
 #include <revival/vulkan/pipeline_builder.h>
 #include <revival/vulkan/descriptor_writer.h>
 
-void BillboardPass::init(VulkanGraphics &graphics, std::vector<Texture> &textures)
+void BillboardPass::init(VulkanGraphics &graphics)
 {
     VkDevice device = graphics.getDevice();
 
-    graphics.createBuffer(uboBuffer, sizeof(UBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-    vkutils::setDebugName(device, (uint64_t)uboBuffer.buffer, VK_OBJECT_TYPE_BUFFER, "billboardUBO");
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        graphics.createBuffer(uboBuffers[i], sizeof(UBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryClass::Dynamic);
+        vkutils::setDebugName(device, (uint64_t)uboBuffers[i].buffer, VK_OBJECT_TYPE_BUFFER, ("billboardUBO " + std::to_string(i)).c_str());
+    }
 
     std::vector<Vertex> vertices = {
         {{-1.0, -1.0f, 0.0f}, {0.0f, 1.0f}, {}},
@@ -22,45 +24,37 @@ void BillboardPass::init(VulkanGraphics &graphics, std::vector<Texture> &texture
     };
 
     uint32_t vertexBufferSize = vertices.size() * sizeof(Vertex);
-    graphics.createBuffer(vertexBuffer, vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    graphics.createBuffer(vertexBuffer, vertexBufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::DeviceStatic);
     graphics.uploadBuffer(vertexBuffer, vertices.data(), vertexBufferSize);
 
-    uint32_t texturesSize = textures.size() > 0 ? textures.size() : 1; // use 1 to silent validation layers
-
     //
-    // Descriptor set
+    // Descriptor sets (one per frame in flight), textures come from the bindless table in set 1
     //
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}, // ubo
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(texturesSize)},
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 * FRAMES_IN_FLIGHT}, // ubo
     };
 
     pool = vkutils::createDescriptorPool(device, poolSizes);
 
     std::vector<VkDescriptorSetLayoutBinding> bindings = {
         {0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT}, // ubo
-        {1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(texturesSize), VK_SHADER_STAGE_FRAGMENT_BIT}, // textures
     };
 
     setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), nullptr);
-    set = vkutils::createDescriptorSet(device, pool, setLayout);
-
-    DescriptorWriter writer;
-    writer.write(0, uboBuffer.buffer, uboBuffer.size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    std::vector<VkDescriptorImageInfo> textureInfos(textures.size());
-    if (textures.size() > 0) {
-        for (size_t i = 0; i < textures.size(); i++) {
-            textureInfos[i].imageView = textures[i].image.view;
-            textureInfos[i].sampler = textures[i].image.sampler;
-            textureInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
-        }
-        writer.write(1, textureInfos.data(), textureInfos.size(), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        sets[i] = vkutils::createDescriptorSet(device, pool, setLayout);
+
+        DescriptorWriter writer;
+        writer.write(0, uboBuffers[i].buffer, uboBuffers[i].size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        writer.update(device, sets[i]);
     }
-    writer.update(device, set);
+}
+
+void BillboardPass::createPipeline(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
 
-    //
-    // Pipeline
-    //
     auto vertex = vkutils::loadShaderModule(device, "build/shaders/billboard.vert.spv");
     auto fragment = vkutils::loadShaderModule(device, "build/shaders/billboard.frag.spv");
     vkutils::setDebugName(device, (uint64_t)vertex, VK_OBJECT_TYPE_SHADER_MODULE, "billboard.vert");
@@ -68,10 +62,13 @@ void BillboardPass::init(VulkanGraphics &graphics, std::vector<Texture> &texture
 
     // create pipeline layout
     VkPushConstantRange pushConstant = {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(PushConstant)};
-    layout = vkutils::createPipelineLayout(device, &setLayout, &pushConstant);
+    VkDescriptorSetLayout setLayouts[] = {setLayout, graphics.getTextureRegistry().getSetLayout()};
+    layout = vkutils::createPipelineLayout(device, setLayouts, 2, &pushConstant);
 
     // create pipeline
     PipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setAttachmentFormats(graphics.getSwapchainFormat(), graphics.getDepthFormat());
     builder.setPipelineLayout(layout);
     builder.setShader(vertex, VK_SHADER_STAGE_VERTEX_BIT);
     builder.setShader(fragment, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -87,55 +84,35 @@ void BillboardPass::init(VulkanGraphics &graphics, std::vector<Texture> &texture
     vkDestroyShaderModule(device, fragment, nullptr);
 }
 
-void BillboardPass::shutdown(VulkanGraphics &graphics, VkDevice device)
+void BillboardPass::shutdown(VulkanGraphics &graphics)
 {
-    graphics.destroyBuffer(uboBuffer);
+    for (auto &uboBuffer : uboBuffers)
+        graphics.destroyBuffer(uboBuffer);
     graphics.destroyBuffer(vertexBuffer);
 
-    vkDestroyPipelineLayout(device, layout, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyDescriptorPool(device, pool, nullptr);
-    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    graphics.destroyPipeline(pipeline, layout);
+    graphics.destroyDescriptors(pool, setLayout);
 }
 
-void BillboardPass::beginFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, Camera &camera)
+void BillboardPass::bind(VulkanGraphics &graphics, VkCommandBuffer cmd, Camera &camera)
 {
+    uint32_t frame = graphics.getCurrentFrame();
+
     // update ubo
     UBO ubo;
     ubo.viewProj = camera.getProjection() * camera.getView();
     ubo.cameraRight = camera.getRight();
     ubo.cameraUp = camera.getUp();
-    memcpy(uboBuffer.info.pMappedData, &ubo, sizeof(ubo));
-
-    Image swapchainImage = {};
-    swapchainImage.view = graphics.getSwapchainImageView();
-    swapchainImage.handle = graphics.getSwapchainImage();
-
-    VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
-    colorAttachment.imageView = swapchainImage.view;
-    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    std::vector<std::pair<VkRenderingAttachmentInfo, Image>> attachments = {
-        std::make_pair(colorAttachment, swapchainImage),
-    };
-
-    graphics.beginFrame(cmd, attachments, graphics.getSwapchainExtent());
+    memcpy(uboBuffers[frame].info.pMappedData, &ubo, sizeof(ubo));
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &set, 0, nullptr);
+    VkDescriptorSet descriptorSets[] = {sets[frame], graphics.getTextureRegistry().getSet()};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, descriptorSets, 0, nullptr);
 
     VkDeviceSize offset = {0};
     vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer.buffer, &offset);
 }
 
-void BillboardPass::endFrame(VulkanGraphics &graphics, VkCommandBuffer cmd)
-{
-    graphics.endFrame(cmd);
-}
-
 void BillboardPass::render(VkCommandBuffer cmd, VkDevice device, vec3 center, vec2 size, int textureIndex)
 {
     PushConstant push = {};
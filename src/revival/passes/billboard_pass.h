@@ -2,20 +2,21 @@
 
 #include <revival/vulkan/common.h>
 #include <revival/vulkan/resources.h>
+#include <revival/vulkan/graphics.h>
 #include <revival/types.h>
 #include <revival/camera.h>
 
-class VulkanGraphics;
-
 class BillboardPass
 {
 public:
-    void init(VulkanGraphics &graphics, std::vector<Texture> &textures);
-    void shutdown(VulkanGraphics &graphics, VkDevice device);
+    void init(VulkanGraphics &graphics);
+    void createPipeline(VulkanGraphics &graphics);
+    void shutdown(VulkanGraphics &graphics);
 
-    void beginFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, Camera &camera);
-    void endFrame(VulkanGraphics &graphics, VkCommandBuffer cmd);
+    // updates the camera ubo and binds pipeline state, swapchain color has to be the current attachment
+    void bind(VulkanGraphics &graphics, VkCommandBuffer cmd, Camera &camera);
 
+    // textureIndex is a bindless texture slot
     void render(VkCommandBuffer cmd, VkDevice device, vec3 center, vec2 size, int textureIndex);
 private:
     VkPipelineLayout layout;
@@ -23,7 +24,7 @@ private:
 
     VkDescriptorPool pool;
     VkDescriptorSetLayout setLayout;
-    VkDescriptorSet set;
+    std::array<VkDescriptorSet, FRAMES_IN_FLIGHT> sets;
 
     struct UBO
     {
@@ -31,7 +32,7 @@ private:
         alignas(16) vec3 cameraUp;
         alignas(16) vec3 cameraRight;
     };
-    Buffer uboBuffer;
+    std::array<Buffer, FRAMES_IN_FLIGHT> uboBuffers;
 
     struct PushConstant
     {
@@ -0,0 +1,301 @@
+#include <revival/passes/cull_pass.h>
+#include <revival/vulkan/utils.h>
+#include <revival/vulkan/graphics.h>
+#include <revival/vulkan/compute_pipeline_builder.h>
+#include <revival/vulkan/descriptor_writer.h>
+#include <revival/profiler.h>
+#include <algorithm>
+
+void CullPass::init(VulkanGraphics &graphics, Image &depthPyramid)
+{
+    VkDevice device = graphics.getDevice();
+
+    //
+    // Create resources
+    //
+    graphics.createBuffer(meshBuffer, MAX_GPU_MESHES * sizeof(MeshData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::DeviceStatic);
+    graphics.createBuffer(visibilityBuffer, MAX_GPU_INSTANCES * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::DeviceStatic);
+
+    // nothing was visible before the first frame, the late phase draws everything once
+    std::vector<uint32_t> visibility(MAX_GPU_INSTANCES, 0);
+    graphics.uploadBuffer(visibilityBuffer, visibility.data(), visibilityBuffer.size);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        graphics.createBuffer(instanceBuffers[i], MAX_GPU_INSTANCES * sizeof(InstanceData), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryClass::Dynamic);
+        graphics.createBuffer(drawBuffers[i], CULL_VIEW_COUNT * MAX_GPU_DRAWS * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::DeviceStatic);
+        graphics.createBuffer(drawTemplateBuffers[i], CULL_VIEW_COUNT * MAX_GPU_DRAWS * sizeof(VkDrawIndexedIndirectCommand), VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryClass::Dynamic);
+        graphics.createBuffer(drawInstanceBuffers[i], CULL_VIEW_COUNT * MAX_GPU_INSTANCES * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryClass::Dynamic);
+        graphics.createBuffer(countBuffers[i], CULL_VIEW_COUNT * sizeof(uint32_t), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::DeviceStatic);
+        graphics.createBuffer(viewBuffers[i], CULL_VIEW_COUNT * sizeof(CullView), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryClass::Dynamic);
+    }
+
+    //
+    // Descriptor sets (one per frame in flight)
+    //
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 6 * FRAMES_IN_FLIGHT}, // instances, meshes, draws, views, visibility, draw instances
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 * FRAMES_IN_FLIGHT}, // depth pyramid
+    };
+
+    pool = vkutils::createDescriptorPool(device, poolSizes);
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // instances
+        {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // meshes
+        {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // draws
+        {4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // views
+        {5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // visibility
+        {6, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // depth pyramid
+        {7, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // draw instances
+    };
+
+    setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), nullptr);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        sets[i] = vkutils::createDescriptorSet(device, pool, setLayout);
+
+        DescriptorWriter writer;
+        writer.write(0, instanceBuffers[i].buffer, instanceBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(1, meshBuffer.buffer, meshBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(2, drawBuffers[i].buffer, drawBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(4, viewBuffers[i].buffer, viewBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(5, visibilityBuffer.buffer, visibilityBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(6, depthPyramid.view, depthPyramid.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        writer.write(7, drawInstanceBuffers[i].buffer, drawInstanceBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.update(device, sets[i]);
+
+        depthPyramidViews[i] = depthPyramid.view;
+    }
+}
+
+void CullPass::createPipeline(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
+
+    auto compute = vkutils::loadShaderModule(device, "build/shaders/cull.comp.spv");
+    vkutils::setDebugName(device, (uint64_t)compute, VK_OBJECT_TYPE_SHADER_MODULE, "cull.comp");
+
+    // create pipeline layout
+    VkPushConstantRange pushConstant = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant)};
+    layout = vkutils::createPipelineLayout(device, &setLayout, &pushConstant);
+
+    // create pipeline
+    ComputePipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setPipelineLayout(layout);
+    builder.setShader(compute);
+    pipeline = builder.build(device);
+    vkutils::setDebugName(device, (uint64_t)pipeline, VK_OBJECT_TYPE_PIPELINE, "cull pipeline");
+
+    vkDestroyShaderModule(device, compute, nullptr);
+}
+
+void CullPass::shutdown(VulkanGraphics &graphics)
+{
+    graphics.destroyBuffer(meshBuffer);
+    graphics.destroyBuffer(visibilityBuffer);
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        graphics.destroyBuffer(instanceBuffers[i]);
+        graphics.destroyBuffer(drawBuffers[i]);
+        graphics.destroyBuffer(drawTemplateBuffers[i]);
+        graphics.destroyBuffer(drawInstanceBuffers[i]);
+        graphics.destroyBuffer(countBuffers[i]);
+        graphics.destroyBuffer(viewBuffers[i]);
+    }
+
+    graphics.destroyPipeline(pipeline, layout);
+    graphics.destroyDescriptors(pool, setLayout);
+}
+
+uint32_t CullPass::addScene(VulkanGraphics &graphics, Scene &scene)
+{
+    auto it = sceneMeshOffsets.find(&scene);
+    if (it != sceneMeshOffsets.end())
+        return it->second;
+
+    uint32_t offset = meshes.size();
+    assert(offset + scene.meshes.size() <= MAX_GPU_MESHES);
+
+    for (auto &mesh : scene.meshes) {
+        MeshData &data = meshes.emplace_back();
+        data.sphere = vec4(mesh.sphere.center, mesh.sphere.radius);
+        data.firstIndex = mesh.indexOffset;
+        data.indexCount = mesh.indexCount;
+    }
+
+    // records of other scenes are never rewritten, frames in flight may still read them
+    graphics.getUploadQueue().uploadBuffer(meshBuffer, meshes.data() + offset, scene.meshes.size() * sizeof(MeshData), offset * sizeof(MeshData));
+
+    sceneMeshOffsets[&scene] = offset;
+    return offset;
+}
+
+void CullPass::update(VulkanGraphics &graphics, std::vector<GameObject> &gameObjects, const std::vector<uint32_t> &indices, vec3 eye)
+{
+    PROFILE_FUNCTION();
+
+    uint32_t frame = graphics.getCurrentFrame();
+
+    // the draw instance indices are written by culling
+    batcher.begin(instanceBuffers[frame], nullptr, MAX_GPU_INSTANCES);
+    batcher.build(gameObjects, indices, eye, batches);
+    instanceCount = batcher.getInstanceCount();
+
+    // visibility indices count the meshes of every game object, culled or not
+    visibilityOffsets.resize(gameObjects.size());
+    uint32_t visibilityIndex = 0;
+    for (uint32_t objectIndex = 0; objectIndex < gameObjects.size(); objectIndex++) {
+        visibilityOffsets[objectIndex] = visibilityIndex;
+        if (gameObjects[objectIndex].scene)
+            visibilityIndex += gameObjects[objectIndex].scene->meshes.size();
+    }
+
+    // NOTE: batches over the limit are not drawn, nor culled
+    drawCount = std::min<uint32_t>(batches.size(), MAX_GPU_DRAWS);
+    if (drawCount < batches.size())
+        instanceCount = batches[drawCount].firstInstance;
+
+    // same keys as the recorded path, the draws of a view run by material and front to back from the camera
+    drawList.clear();
+    for (uint32_t i = 0; i < drawCount; i++)
+        drawList.add(DrawList::makeKey(DRAW_PASS_OPAQUE, 0, batches[i].mesh->materialIndex, batches[i].depth), i);
+    drawList.sort();
+    std::vector<DrawItem> &items = drawList.getItems();
+
+    InstanceData *instances = static_cast<InstanceData*>(instanceBuffers[frame].info.pMappedData);
+    const std::vector<uint32_t> &instanceObjects = batcher.getInstanceObjects();
+
+    for (uint32_t draw = 0; draw < drawCount; draw++) {
+        const InstanceBatch &batch = batches[items[draw].index];
+
+        // all instances of a batch are game objects of the same scene
+        Scene &scene = *gameObjects[instanceObjects[batch.firstInstance]].scene;
+        uint32_t meshInScene = batch.mesh - scene.meshes.data();
+        uint32_t meshIndex = addScene(graphics, scene) + meshInScene;
+
+        for (uint32_t i = batch.firstInstance; i < batch.firstInstance + batch.instanceCount; i++) {
+            uint32_t objectIndex = instanceObjects[i];
+
+            InstanceData &instance = instances[i];
+            instance.meshIndex = meshIndex;
+            // NOTE: meshes over the limit share the last visibility slot
+            instance.visibilityIndex = std::min(visibilityOffsets[objectIndex] + meshInScene, MAX_GPU_INSTANCES - 1);
+            instance.drawIndex = draw;
+        }
+    }
+
+    // every view draws the batches in the same order, culling fills in the instance counts
+    VkDrawIndexedIndirectCommand *templates = static_cast<VkDrawIndexedIndirectCommand*>(drawTemplateBuffers[frame].info.pMappedData);
+    for (uint32_t view = 0; view < CULL_VIEW_COUNT; view++) {
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            const InstanceBatch &batch = batches[items[draw].index];
+
+            VkDrawIndexedIndirectCommand &command = templates[view * MAX_GPU_DRAWS + draw];
+            command.indexCount = batch.mesh->indexCount;
+            command.instanceCount = 0;
+            command.firstIndex = batch.mesh->indexOffset;
+            command.vertexOffset = 0;
+            command.firstInstance = view * MAX_GPU_INSTANCES + batch.firstInstance;
+        }
+    }
+}
+
+void CullPass::setDepthPyramid(VulkanGraphics &graphics, Image &depthPyramid, VkExtent2D extent)
+{
+    uint32_t frame = graphics.getCurrentFrame();
+    depthPyramidExtent = extent;
+
+    if (depthPyramidViews[frame] == depthPyramid.view)
+        return;
+
+    // the last frame that used this set has finished
+    DescriptorWriter writer;
+    writer.write(6, depthPyramid.view, depthPyramid.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+    writer.update(graphics.getDevice(), sets[frame]);
+
+    depthPyramidViews[frame] = depthPyramid.view;
+}
+
+void CullPass::execute(VulkanGraphics &graphics, const mat4 &sceneViewProjection, const mat4 &shadowViewProjection, bool occlusionCulling)
+{
+    PROFILE_FUNCTION();
+
+    uint32_t frame = graphics.getCurrentFrame();
+
+    // the late phase tests the scene view again
+    CullView *views = static_cast<CullView*>(viewBuffers[frame].info.pMappedData);
+    const mat4 *viewProjections[CULL_VIEW_COUNT] = {&sceneViewProjection, &shadowViewProjection, &sceneViewProjection};
+    for (uint32_t view = 0; view < CULL_VIEW_COUNT; view++) {
+        math::extractFrustumPlanes(*viewProjections[view], views[view].planes);
+        views[view].viewProjection = *viewProjections[view];
+    }
+
+    VkCommandBuffer cmd = graphics.beginComputeCommandBuffer();
+    vkutils::beginDebugLabel(cmd, "Cull", {0.6, 0.3, 0.0, 1.0});
+
+    // draws with no instances, every view issues all of them
+    if (drawCount > 0) {
+        VkBufferCopy regions[CULL_VIEW_COUNT];
+        for (uint32_t view = 0; view < CULL_VIEW_COUNT; view++) {
+            VkDeviceSize offset = view * MAX_GPU_DRAWS * sizeof(VkDrawIndexedIndirectCommand);
+            regions[view] = {offset, offset, drawCount * sizeof(VkDrawIndexedIndirectCommand)};
+        }
+        vkCmdCopyBuffer(cmd, drawTemplateBuffers[frame].buffer, drawBuffers[frame].buffer, CULL_VIEW_COUNT, regions);
+    }
+    vkCmdFillBuffer(cmd, countBuffers[frame].buffer, 0, VK_WHOLE_SIZE, drawCount);
+
+    VkMemoryBarrier copyBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    copyBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    copyBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &copyBarrier, 0, nullptr, 0, nullptr);
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &sets[frame], 0, nullptr);
+
+    PushConstant push = {};
+    push.instanceCount = instanceCount;
+    push.maxDraws = MAX_GPU_DRAWS;
+    push.phase = 0;
+
+    for (uint32_t view : {CULL_VIEW_SCENE, CULL_VIEW_SHADOW}) {
+        push.view = view;
+        push.occlusionCulling = view == CULL_VIEW_SCENE && occlusionCulling;
+
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+        vkCmdDispatch(cmd, (instanceCount + 63) / 64, 1, 1);
+    }
+
+    vkutils::endDebugLabel(cmd);
+
+    // the semaphore wait makes the writes available to the indirect draws and the late phase. The early phase reads
+    // the visibility the late phase of the previous frame wrote, so it waits for that frame's graphics work
+    VkPipelineStageFlags previousFrameWaitStages = occlusionCulling ? VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT : 0;
+    graphics.submitComputeCommandBuffer(cmd, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, previousFrameWaitStages);
+}
+
+void CullPass::executeLate(VulkanGraphics &graphics, VkCommandBuffer cmd)
+{
+    uint32_t frame = graphics.getCurrentFrame();
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &sets[frame], 0, nullptr);
+
+    PushConstant push = {};
+    push.instanceCount = instanceCount;
+    push.view = CULL_VIEW_SCENE_LATE;
+    push.maxDraws = MAX_GPU_DRAWS;
+    push.phase = 1;
+    push.depthPyramidSize = vec2(depthPyramidExtent.width, depthPyramidExtent.height);
+    push.occlusionCulling = 1;
+
+    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+    vkCmdDispatch(cmd, (instanceCount + 63) / 64, 1, 1);
+}
+
+void CullPass::drawIndirect(VulkanGraphics &graphics, VkCommandBuffer cmd, uint32_t view)
+{
+    uint32_t frame = graphics.getCurrentFrame();
+    VkDeviceSize drawOffset = view * MAX_GPU_DRAWS * sizeof(VkDrawIndexedIndirectCommand);
+
+    vkCmdDrawIndexedIndirectCount(cmd, drawBuffers[frame].buffer, drawOffset, countBuffers[frame].buffer, view * sizeof(uint32_t), drawCount, sizeof(VkDrawIndexedIndirectCommand));
+}
@@ -0,0 +1,128 @@
+#pragma once
+
+#include <revival/vulkan/common.h>
+#include <revival/vulkan/resources.h>
+#include <revival/vulkan/graphics.h>
+#include <revival/types.h>
+
+#include <revival/game_object.h>
+#include <revival/instance_batcher.h>
+#include <revival/draw_list.h>
+#include <unordered_map>
+
+const uint32_t MAX_GPU_INSTANCES = 65536;
+const uint32_t MAX_GPU_MESHES = 4096;
+// instanced draws per view, one per mesh of every scene at most
+const uint32_t MAX_GPU_DRAWS = MAX_GPU_MESHES;
+
+// views culled every frame, each has its own range of draw commands
+const uint32_t CULL_VIEW_SCENE = 0;
+const uint32_t CULL_VIEW_SHADOW = 1;
+// scene instances the early test skipped that pass the depth pyramid of this frame, culled on the graphics queue
+const uint32_t CULL_VIEW_SCENE_LATE = 2;
+const uint32_t CULL_VIEW_COUNT = 3;
+
+// GPU driven path. Every mesh of every game object in the frustum of a view is an instance in a per frame storage
+// buffer, grouped by InstanceBatcher into one instanced indirect draw per mesh of a scene. cull.comp tests the bounding
+// spheres against the frustum of each view on the compute queue, bumps the instance count of the draw of every visible
+// instance and writes its index into the draw's range of the draw instance buffer. The scene and shadow passes consume
+// them with one vkCmdDrawIndexedIndirectCount each, in the DrawList order of the recorded path.
+//
+// With occlusion culling the scene view runs in two phases. The early phase only keeps instances that were visible in
+// the previous frame, they are drawn and reduced into the depth pyramid. The late phase tests every instance against
+// the pyramid, draws the visible ones the early phase skipped, so nothing pops in, and records visibility for the next
+// early phase. That wait costs the overlap of the early culling with the end of the previous frame, the shadow view is
+// culled in the same dispatch so it waits as well.
+//
+// Shadows are frustum culled only. Occlusion culling them would need a pyramid per light built from its previous
+// shadow map, with a late shadow pass of its own before the scene samples the map, that is left for later.
+class CullPass
+{
+public:
+    void init(VulkanGraphics &graphics, Image &depthPyramid);
+    void createPipeline(VulkanGraphics &graphics);
+    void shutdown(VulkanGraphics &graphics);
+
+    // writes the instances and draws of the game objects at indices (ascending, FrustumCuller output), meshes of scenes
+    // seen for the first time are uploaded
+    void update(VulkanGraphics &graphics, std::vector<GameObject> &gameObjects, const std::vector<uint32_t> &indices, vec3 eye);
+
+    // the pyramid executeLate tests against, has to be set before execute when it was recreated
+    void setDepthPyramid(VulkanGraphics &graphics, Image &depthPyramid, VkExtent2D extent);
+
+    // records and submits the early culling of the scene and shadow views, the frame waits for it before drawing indirect
+    void execute(VulkanGraphics &graphics, const mat4 &sceneViewProjection, const mat4 &shadowViewProjection, bool occlusionCulling);
+    // late phase into CULL_VIEW_SCENE_LATE, the depth pyramid of this frame has to be readable by compute
+    void executeLate(VulkanGraphics &graphics, VkCommandBuffer cmd);
+
+    // one indirect draw of the visible instances of view, pipeline and index buffer have to be bound
+    void drawIndirect(VulkanGraphics &graphics, VkCommandBuffer cmd, uint32_t view);
+
+    std::array<Buffer, FRAMES_IN_FLIGHT> &getInstanceBuffers() { return instanceBuffers; };
+    // instance index at gl_InstanceIndex of the passes' instanced pipelines, host visible for the recorded path
+    std::array<Buffer, FRAMES_IN_FLIGHT> &getDrawInstanceBuffers() { return drawInstanceBuffers; };
+    Buffer &getDrawBuffer(uint32_t frame) { return drawBuffers[frame]; };
+    Buffer &getCountBuffer(uint32_t frame) { return countBuffers[frame]; };
+    uint32_t getInstanceCount() { return instanceCount; };
+    uint32_t getDrawCount() { return drawCount; };
+private:
+    uint32_t addScene(VulkanGraphics &graphics, Scene &scene);
+
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+
+    VkDescriptorPool pool;
+    VkDescriptorSetLayout setLayout;
+    std::array<VkDescriptorSet, FRAMES_IN_FLIGHT> sets;
+
+    std::array<Buffer, FRAMES_IN_FLIGHT> instanceBuffers;
+    // draw commands of all views, CULL_VIEW_COUNT * MAX_GPU_DRAWS. Copied from the templates with no instances, before
+    // the early phase
+    std::array<Buffer, FRAMES_IN_FLIGHT> drawBuffers;
+    std::array<Buffer, FRAMES_IN_FLIGHT> drawTemplateBuffers;
+    // CULL_VIEW_COUNT * MAX_GPU_INSTANCES, a draw's instances start at its firstInstance
+    std::array<Buffer, FRAMES_IN_FLIGHT> drawInstanceBuffers;
+    std::array<Buffer, FRAMES_IN_FLIGHT> countBuffers;
+    // frustum planes and view projection of every view
+    std::array<Buffer, FRAMES_IN_FLIGHT> viewBuffers;
+    std::array<VkImageView, FRAMES_IN_FLIGHT> depthPyramidViews = {};
+    VkExtent2D depthPyramidExtent = {0, 0};
+
+    // meshes of every drawn scene, only appended to so the frames in flight never see a record change
+    Buffer meshBuffer;
+    // one uint per mesh of every game object (InstanceData::visibilityIndex), shared by the frames in flight. Written by
+    // the late phase on the graphics queue and read by the early phase of the next frame, whose compute submit waits
+    // for the previous frame's graphics work. Indices are stable while game objects are only appended, frustum culled
+    // ones keep theirs.
+    Buffer visibilityBuffer;
+    std::vector<MeshData> meshes;
+    std::unordered_map<const Scene*, uint32_t> sceneMeshOffsets;
+
+    uint32_t instanceCount = 0;
+    uint32_t drawCount = 0;
+
+    InstanceBatcher batcher;
+    std::vector<InstanceBatch> batches;
+    // draw order of the batches, the shadow view shares the camera's
+    DrawList drawList;
+    // first visibility index of every game object
+    std::vector<uint32_t> visibilityOffsets;
+
+    // should match the shader
+    struct CullView
+    {
+        vec4 planes[6];
+        mat4 viewProjection;
+    };
+
+    struct PushConstant
+    {
+        uint32_t instanceCount;
+        uint32_t view;
+        uint32_t maxDraws;
+        // 0 early, 1 late
+        uint32_t phase;
+        vec2 depthPyramidSize;
+        uint32_t occlusionCulling;
+    };
+};
@@ -0,0 +1,163 @@
+#include <revival/passes/depth_pyramid_pass.h>
+#include <revival/vulkan/utils.h>
+#include <revival/vulkan/graphics.h>
+#include <revival/vulkan/compute_pipeline_builder.h>
+#include <revival/vulkan/descriptor_writer.h>
+#include <revival/profiler.h>
+#include <algorithm>
+
+void DepthPyramidPass::init(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
+
+    //
+    // Descriptor sets (one per level and frame in flight)
+    //
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, MAX_PYRAMID_LEVELS * FRAMES_IN_FLIGHT},
+        {VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, MAX_PYRAMID_LEVELS * FRAMES_IN_FLIGHT},
+    };
+
+    pool = vkutils::createDescriptorPool(device, poolSizes);
+
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // input
+        {1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT}, // output
+    };
+
+    setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), nullptr);
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        for (uint32_t level = 0; level < MAX_PYRAMID_LEVELS; level++)
+            sets[i][level] = vkutils::createDescriptorSet(device, pool, setLayout);
+    }
+
+    resize(graphics, graphics.getSwapchainExtent());
+}
+
+void DepthPyramidPass::createPipeline(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
+
+    auto compute = vkutils::loadShaderModule(device, "build/shaders/depth_reduce.comp.spv");
+    vkutils::setDebugName(device, (uint64_t)compute, VK_OBJECT_TYPE_SHADER_MODULE, "depth_reduce.comp");
+
+    // create pipeline layout
+    VkPushConstantRange pushConstant = {VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(PushConstant)};
+    layout = vkutils::createPipelineLayout(device, &setLayout, &pushConstant);
+
+    // create pipeline
+    ComputePipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setPipelineLayout(layout);
+    builder.setShader(compute);
+    pipeline = builder.build(device);
+    vkutils::setDebugName(device, (uint64_t)pipeline, VK_OBJECT_TYPE_PIPELINE, "depth reduce pipeline");
+
+    vkDestroyShaderModule(device, compute, nullptr);
+}
+
+void DepthPyramidPass::shutdown(VulkanGraphics &graphics)
+{
+    destroyPyramid(graphics);
+
+    graphics.destroyPipeline(pipeline, layout);
+    graphics.destroyDescriptors(pool, setLayout);
+}
+
+bool DepthPyramidPass::resize(VulkanGraphics &graphics, VkExtent2D depthExtent)
+{
+    // power of two below the depth size, so every level halves exactly
+    VkExtent2D newExtent = {1, 1};
+    while (newExtent.width * 2 <= depthExtent.width) newExtent.width *= 2;
+    while (newExtent.height * 2 <= depthExtent.height) newExtent.height *= 2;
+
+    if (newExtent.width == extent.width && newExtent.height == extent.height)
+        return false;
+
+    if (levelCount > 0)
+        destroyPyramid(graphics);
+
+    extent = newExtent;
+    levelCount = 1;
+    while ((std::max(extent.width, extent.height) >> levelCount) > 0 && levelCount < MAX_PYRAMID_LEVELS)
+        levelCount++;
+
+    // nearest, culling fetches the texels a bounds rectangle touches and reduces them itself
+    SamplerDesc sampler;
+    sampler.minFilter = VK_FILTER_NEAREST;
+    sampler.magFilter = VK_FILTER_NEAREST;
+    sampler.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    sampler.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+
+    graphics.createImage(pyramid, extent.width, extent.height, VK_FORMAT_R32_SFLOAT, VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, sampler, false, levelCount);
+    vkutils::setDebugName(graphics.getDevice(), (uint64_t)pyramid.handle, VK_OBJECT_TYPE_IMAGE, "depth pyramid");
+
+    levelViews.resize(levelCount);
+    for (uint32_t level = 0; level < levelCount; level++) {
+        VkImageViewCreateInfo viewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        viewInfo.image = pyramid.handle;
+        viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        viewInfo.format = VK_FORMAT_R32_SFLOAT;
+        viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        VK_CHECK(vkCreateImageView(graphics.getDevice(), &viewInfo, nullptr, &levelViews[level]));
+    }
+
+    return true;
+}
+
+void DepthPyramidPass::destroyPyramid(VulkanGraphics &graphics)
+{
+    graphics.destroyDeferred([device = graphics.getDevice(), views = levelViews]() {
+        for (auto view : views)
+            vkDestroyImageView(device, view, nullptr);
+    });
+    graphics.destroyImage(pyramid);
+
+    levelViews.clear();
+    levelCount = 0;
+}
+
+void DepthPyramidPass::render(VulkanGraphics &graphics, VkCommandBuffer cmd, VkImageView depthView, VkExtent2D depthExtent)
+{
+    PROFILE_FUNCTION();
+
+    VkDevice device = graphics.getDevice();
+    uint32_t frame = graphics.getCurrentFrame();
+
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+
+    VkExtent2D inputExtent = depthExtent;
+    for (uint32_t level = 0; level < levelCount; level++) {
+        VkExtent2D outputExtent = {std::max(extent.width >> level, 1u), std::max(extent.height >> level, 1u)};
+
+        // transient depth views can change between frames, the sets of this frame are no longer in use
+        DescriptorWriter writer;
+        if (level == 0)
+            writer.write(0, depthView, pyramid.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        else
+            writer.write(0, levelViews[level - 1], pyramid.sampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        writer.write(1, levelViews[level], pyramid.sampler, VK_IMAGE_LAYOUT_GENERAL, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE);
+        writer.update(device, sets[frame][level]);
+
+        vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, layout, 0, 1, &sets[frame][level], 0, nullptr);
+
+        PushConstant push = {{inputExtent.width, inputExtent.height}, {outputExtent.width, outputExtent.height}};
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(push), &push);
+        vkCmdDispatch(cmd, (outputExtent.width + 7) / 8, (outputExtent.height + 7) / 8, 1);
+
+        // the next level reads this one
+        VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+        barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.image = pyramid.handle;
+        barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 1, &barrier);
+
+        inputExtent = outputExtent;
+    }
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <revival/vulkan/common.h>
+#include <revival/vulkan/resources.h>
+#include <revival/types.h>
+
+class VulkanGraphics;
+
+const uint32_t MAX_PYRAMID_LEVELS = 16;
+
+// Hierarchical depth for occlusion culling. The first level is the scene depth reduced to the power of two below its
+// size, every texel of every level keeps the farthest (reversed-Z: smallest) depth of the texels it covers.
+class DepthPyramidPass
+{
+public:
+    void init(VulkanGraphics &graphics);
+    void createPipeline(VulkanGraphics &graphics);
+    void shutdown(VulkanGraphics &graphics);
+
+    // recreates the pyramid when the depth size changed, the old one is destroyed once no frame uses it.
+    // Returns true when it did, the new image may reuse the handle of the old one
+    bool resize(VulkanGraphics &graphics, VkExtent2D depthExtent);
+
+    // depth has to be sampled by compute, the pyramid in general layout
+    void render(VulkanGraphics &graphics, VkCommandBuffer cmd, VkImageView depthView, VkExtent2D depthExtent);
+
+    Image &getImage() { return pyramid; };
+    VkExtent2D getExtent() { return extent; };
+    uint32_t getLevelCount() { return levelCount; };
+private:
+    void destroyPyramid(VulkanGraphics &graphics);
+
+    VkPipelineLayout layout;
+    VkPipeline pipeline;
+
+    VkDescriptorPool pool;
+    VkDescriptorSetLayout setLayout;
+    // one per level, input is the previous level or the depth
+    std::array<std::array<VkDescriptorSet, MAX_PYRAMID_LEVELS>, FRAMES_IN_FLIGHT> sets;
+
+    Image pyramid = {};
+    std::vector<VkImageView> levelViews;
+    VkExtent2D extent = {0, 0};
+    uint32_t levelCount = 0;
+
+    struct PushConstant
+    {
+        uint32_t inputSize[2];
+        uint32_t outputSize[2];
+    };
+};
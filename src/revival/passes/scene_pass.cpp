@@ -4,20 +4,18 @@
 #include <revival/scene_manager.h>
 #include <revival/vulkan/pipeline_builder.h>
 #include <revival/vulkan/descriptor_writer.h>
+#include <cstddef>
 
-void ScenePass::init(VulkanGraphics &graphics, std::vector<Texture> &textures, Buffer &vertexBuffer, Buffer &uboBuffer, Buffer &materialsBuffer, Buffer &lightsBuffer)
+void ScenePass::init(VulkanGraphics &graphics, Buffer &vertexBuffer, std::array<Buffer, FRAMES_IN_FLIGHT> &uboBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &materialsBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &lightsBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &instanceBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &drawInstanceBuffers)
 {
     VkDevice device = graphics.getDevice();
 
     //
-    // Descriptor set
+    // Descriptor sets (one per frame in flight), textures come from the bindless table in set 1
     //
-    size_t texturesSize = textures.size() > 0 ? textures.size() : 1; // use 1 to silent validation layers
-
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(texturesSize)},
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}, // ubo
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3}, // lights, materials, vertices
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 * FRAMES_IN_FLIGHT}, // ubo
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 5 * FRAMES_IN_FLIGHT}, // lights, materials, vertices, instances, draw instances
     };
 
     pool = vkutils::createDescriptorPool(device, poolSizes);
@@ -27,50 +25,54 @@ void ScenePass::init(VulkanGraphics &graphics, std::vector<Texture> &textures, B
         {1, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT}, // ubo
         {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // materials
         {3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_FRAGMENT_BIT}, // lights
-        {4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, static_cast<uint32_t>(texturesSize), VK_SHADER_STAGE_FRAGMENT_BIT}, // textures
+        {4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT}, // instances
+        {5, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT}, // draw instances
     };
 
     setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), nullptr);
-    set = vkutils::createDescriptorSet(device, pool, setLayout);
 
-    DescriptorWriter writer;
-    writer.write(0, vertexBuffer.buffer, vertexBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    writer.write(1, uboBuffer.buffer, uboBuffer.size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        sets[i] = vkutils::createDescriptorSet(device, pool, setLayout);
 
-    if (materialsBuffer.size > 0) {
-        writer.write(2, materialsBuffer.buffer, materialsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    }
+        DescriptorWriter writer;
+        writer.write(0, vertexBuffer.buffer, vertexBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(1, uboBuffers[i].buffer, uboBuffers[i].size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
 
-    if (lightsBuffer.size > 0) {
-        writer.write(3, lightsBuffer.buffer, lightsBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    }
+        if (materialsBuffers[i].size > 0) {
+            writer.write(2, materialsBuffers[i].buffer, materialsBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        }
 
-    std::vector<VkDescriptorImageInfo> textureInfos(textures.size());
-    if (textures.size() > 0) {
-        for (size_t i = 0; i < textures.size(); i++) {
-            textureInfos[i].imageView = textures[i].image.view;
-            textureInfos[i].sampler = textures[i].image.sampler;
-            textureInfos[i].imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+        if (lightsBuffers[i].size > 0) {
+            writer.write(3, lightsBuffers[i].buffer, lightsBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
         }
-        writer.write(4, textureInfos.data(), textureInfos.size(), VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+
+        writer.write(4, instanceBuffers[i].buffer, instanceBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(5, drawInstanceBuffers[i].buffer, drawInstanceBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+
+        writer.update(device, sets[i]);
     }
+}
 
-    writer.update(device, set);
+void ScenePass::createPipeline(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
 
-    //
-    // Pipeline
-    //
     auto vertex = vkutils::loadShaderModule(device, "build/shaders/mesh.vert.spv");
     auto fragment = vkutils::loadShaderModule(device, "build/shaders/mesh.frag.spv");
+    auto indirectVertex = vkutils::loadShaderModule(device, "build/shaders/mesh_indirect.vert.spv");
     vkutils::setDebugName(device, (uint64_t)vertex, VK_OBJECT_TYPE_SHADER_MODULE, "mesh.vert");
+    vkutils::setDebugName(device, (uint64_t)indirectVertex, VK_OBJECT_TYPE_SHADER_MODULE, "mesh_indirect.vert");
     vkutils::setDebugName(device, (uint64_t)fragment, VK_OBJECT_TYPE_SHADER_MODULE, "mesh.frag");
 
     // create pipeline layout
     VkPushConstantRange pushConstant = {VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(PushConstant)};
-    layout = vkutils::createPipelineLayout(device, &setLayout, &pushConstant);
+    VkDescriptorSetLayout setLayouts[] = {setLayout, graphics.getTextureRegistry().getSetLayout()};
+    layout = vkutils::createPipelineLayout(device, setLayouts, 2, &pushConstant);
 
     // create pipeline
     PipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setAttachmentFormats(graphics.getSwapchainFormat(), graphics.getDepthFormat());
     builder.setPipelineLayout(layout);
     builder.setShader(vertex, VK_SHADER_STAGE_VERTEX_BIT);
     builder.setShader(fragment, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -80,55 +82,58 @@ void ScenePass::init(VulkanGraphics &graphics, std::vector<Texture> &textures, B
     pipeline = builder.build(device);
     vkutils::setDebugName(device, (uint64_t)pipeline, VK_OBJECT_TYPE_PIPELINE, "scene pipeline");
 
+    builder.clearShaders();
+    builder.setShader(indirectVertex, VK_SHADER_STAGE_VERTEX_BIT);
+    builder.setShader(fragment, VK_SHADER_STAGE_FRAGMENT_BIT);
+    indirectPipeline = builder.build(device);
+    vkutils::setDebugName(device, (uint64_t)indirectPipeline, VK_OBJECT_TYPE_PIPELINE, "scene indirect pipeline");
+
     vkDestroyShaderModule(device, vertex, nullptr);
+    vkDestroyShaderModule(device, indirectVertex, nullptr);
     vkDestroyShaderModule(device, fragment, nullptr);
 }
 
-void ScenePass::shutdown(VkDevice device)
+void ScenePass::shutdown(VulkanGraphics &graphics)
 {
-    vkDestroyPipelineLayout(device, layout, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyDescriptorPool(device, pool, nullptr);
-    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    graphics.destroyPipeline(pipeline, layout);
+    graphics.destroyPipeline(indirectPipeline);
+    graphics.destroyDescriptors(pool, setLayout);
 }
 
-void ScenePass::beginFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer &indexBuffer)
+VkCommandBuffer ScenePass::beginSecondary(VulkanGraphics &graphics, uint32_t threadIndex)
 {
-    Image &depthImage = graphics.getDepthImage();
-
-    Image swapchainImage = {};
-    swapchainImage.view = graphics.getSwapchainImageView();
-    swapchainImage.handle = graphics.getSwapchainImage();
-
-    VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
-    colorAttachment.imageView = swapchainImage.view;
-    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    depthAttachment.clearValue.depthStencil = {0.0, 0};
-    depthAttachment.imageView = depthImage.view;
-    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    std::vector<std::pair<VkRenderingAttachmentInfo, Image>> attachments = {
-        std::make_pair(colorAttachment, swapchainImage),
-        std::make_pair(depthAttachment, depthImage),
-    };
+    // same formats the pipelines were built with
+    VkFormat colorFormat = graphics.getSwapchainFormat();
+
+    VkCommandBufferInheritanceRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+    renderingInfo.colorAttachmentCount = 1;
+    renderingInfo.pColorAttachmentFormats = &colorFormat;
+    renderingInfo.depthAttachmentFormat = graphics.getDepthFormat();
+    renderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-    graphics.beginFrame(cmd, attachments, graphics.getSwapchainExtent());
+    VkCommandBuffer cmd = graphics.beginSecondaryCommandBuffer(threadIndex, renderingInfo);
 
+    VkExtent2D extent = graphics.getSwapchainExtent();
+    vkutils::setViewport(cmd, 0.0f, 0.0f, extent.width, extent.height);
+    vkutils::setScissor(cmd, extent);
+
+    return cmd;
+}
+
+void ScenePass::bind(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer)
+{
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &set, 0, nullptr);
+    VkDescriptorSet descriptorSets[] = {sets[graphics.getCurrentFrame()], graphics.getTextureRegistry().getSet()};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, descriptorSets, 0, nullptr);
     vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 }
 
-void ScenePass::endFrame(VulkanGraphics &graphics, VkCommandBuffer cmd)
+void ScenePass::bindIndirect(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer)
 {
-    graphics.endFrame(cmd);
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipeline);
+    VkDescriptorSet descriptorSets[] = {sets[graphics.getCurrentFrame()], graphics.getTextureRegistry().getSet()};
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 2, descriptorSets, 0, nullptr);
+    vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 }
 
 void ScenePass::render(VkCommandBuffer cmd, Scene &scene)
@@ -144,17 +149,27 @@ void ScenePass::render(VkCommandBuffer cmd, Scene &scene)
     }
 }
 
-void ScenePass::render(VkCommandBuffer cmd, GameObject &gameObject)
+void ScenePass::render(VkCommandBuffer cmd, GameObject &gameObject, const Mesh &mesh, DrawState &state)
 {
-    if (!gameObject.scene) return;
-
-    PushConstant push = {};
-    for (auto &mesh : gameObject.scene->meshes) {
-        push.model = gameObject.transform.getModelMatrix() * mesh.matrix;
-        push.materialIndex = mesh.materialIndex;
+    // model differs for every mesh, the material only between runs of the sorted draws
+    mat4 model = gameObject.transform.getModelMatrix() * mesh.matrix;
+    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, offsetof(PushConstant, model), sizeof(mat4), &model);
+    state.pushConstants++;
+
+    if (state.materialIndex != mesh.materialIndex) {
+        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, offsetof(PushConstant, materialIndex), sizeof(int), &mesh.materialIndex);
+        state.materialIndex = mesh.materialIndex;
+        state.pushConstants++;
+    } else {
+        state.skippedPushConstants++;
+    }
 
-        vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(push), &push);
+    vkCmdDrawIndexed(cmd, mesh.indexCount, 1, mesh.indexOffset, 0, 0);
+    state.draws++;
+}
 
-        vkCmdDrawIndexed(cmd, mesh.indexCount, 1, mesh.indexOffset, 0, 0);
-    }
+void ScenePass::render(VkCommandBuffer cmd, const InstanceBatch &batch, DrawState &state)
+{
+    vkCmdDrawIndexed(cmd, batch.mesh->indexCount, batch.instanceCount, batch.mesh->indexOffset, 0, batch.firstInstance);
+    state.draws++;
 }
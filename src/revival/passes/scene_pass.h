@@ -2,30 +2,42 @@
 
 #include <revival/vulkan/common.h>
 #include <revival/vulkan/resources.h>
+#include <revival/vulkan/graphics.h>
 #include <revival/types.h>
 
 #include <revival/game_object.h>
-
-class VulkanGraphics;
+#include <revival/draw_list.h>
 
 class ScenePass
 {
 public:
-    void init(VulkanGraphics &graphics, std::vector<Texture> &textures, Buffer &vertexBuffer, Buffer &uboBuffer, Buffer &materialsBuffer, Buffer &lightsBuffer);
-    void shutdown(VkDevice device);
+    void init(VulkanGraphics &graphics, Buffer &vertexBuffer, std::array<Buffer, FRAMES_IN_FLIGHT> &uboBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &materialsBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &lightsBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &instanceBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &drawInstanceBuffers);
+    void createPipeline(VulkanGraphics &graphics);
+    void shutdown(VulkanGraphics &graphics);
+
+    // binds pipeline state, swapchain color and depth image have to be the current attachments
+    void bind(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer);
+    // same for the instance buffer pipeline, draws come from CullPass::drawIndirect or instanced batches
+    void bindIndirect(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer);
 
-    void beginFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer &indexBuffer);
-    void endFrame(VulkanGraphics &graphics, VkCommandBuffer cmd);
+    // secondary command buffer continuing the pass with viewport and scissor set, bind or bindIndirect it next.
+    // Thread safe per threadIndex.
+    VkCommandBuffer beginSecondary(VulkanGraphics &graphics, uint32_t threadIndex);
 
     void render(VkCommandBuffer cmd, Scene &scene);
-    void render(VkCommandBuffer cmd, GameObject &gameObject);
+    // one mesh of a game object, pushes only what differs from state
+    void render(VkCommandBuffer cmd, GameObject &gameObject, const Mesh &mesh, DrawState &state);
+    // instanced, after bindIndirect with the batch instances in the instance buffer
+    void render(VkCommandBuffer cmd, const InstanceBatch &batch, DrawState &state);
 private:
     VkPipelineLayout layout;
     VkPipeline pipeline;
+    // model and material come from the instance buffer instead of the push constant
+    VkPipeline indirectPipeline;
 
     VkDescriptorPool pool;
     VkDescriptorSetLayout setLayout;
-    VkDescriptorSet set;
+    std::array<VkDescriptorSet, FRAMES_IN_FLIGHT> sets;
 
     struct PushConstant
     {
@@ -13,7 +13,7 @@ void ShadowDebugPass::init(VulkanGraphics &graphics, Buffer &vertexBuffer)
     // Descriptor set
     //
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 * FRAMES_IN_FLIGHT},
     };
 
     pool = vkutils::createDescriptorPool(device, poolSizes);
@@ -23,11 +23,14 @@ void ShadowDebugPass::init(VulkanGraphics &graphics, Buffer &vertexBuffer)
     };
 
     setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), nullptr);
-    set = vkutils::createDescriptorSet(device, pool, setLayout);
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+        sets[i] = vkutils::createDescriptorSet(device, pool, setLayout);
+}
+
+void ShadowDebugPass::createPipeline(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
 
-    //
-    // Pipeline
-    //
     auto vertex = vkutils::loadShaderModule(device, "build/shaders/quad.vert.spv");
     auto fragment = vkutils::loadShaderModule(device, "build/shaders/shadow_debug.frag.spv");
     vkutils::setDebugName(device, (uint64_t)vertex, VK_OBJECT_TYPE_SHADER_MODULE, "quad.vert");
@@ -38,6 +41,8 @@ void ShadowDebugPass::init(VulkanGraphics &graphics, Buffer &vertexBuffer)
 
     // create pipeline
     PipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setAttachmentFormats(graphics.getSwapchainFormat(), graphics.getDepthFormat());
     builder.setPipelineLayout(layout);
     builder.setShader(vertex, VK_SHADER_STAGE_VERTEX_BIT);
     builder.setShader(fragment, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -51,16 +56,16 @@ void ShadowDebugPass::init(VulkanGraphics &graphics, Buffer &vertexBuffer)
     vkDestroyShaderModule(device, fragment, nullptr);
 }
 
-void ShadowDebugPass::shutdown(VkDevice device)
+void ShadowDebugPass::shutdown(VulkanGraphics &graphics)
 {
-    vkDestroyPipelineLayout(device, layout, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyDescriptorPool(device, pool, nullptr);
-    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    graphics.destroyPipeline(pipeline, layout);
+    graphics.destroyDescriptors(pool, setLayout);
 }
 
 void ShadowDebugPass::render(VulkanGraphics &graphics, VkCommandBuffer cmd, Image &shadowMap)
 {
+    VkDescriptorSet set = sets[graphics.getCurrentFrame()];
+
     // XXX: this is not very performant, updated every render.
     DescriptorWriter writer;
     VkDescriptorImageInfo textureInfo = {};
@@ -70,28 +75,9 @@ void ShadowDebugPass::render(VulkanGraphics &graphics, VkCommandBuffer cmd, Imag
     writer.write(0, &textureInfo, 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
     writer.update(graphics.getDevice(), set);
 
-    Image swapchainImage = {};
-    swapchainImage.view = graphics.getSwapchainImageView();
-    swapchainImage.handle = graphics.getSwapchainImage();
-
-    VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
-    colorAttachment.imageView = swapchainImage.view;
-    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    std::vector<std::pair<VkRenderingAttachmentInfo, Image>> attachments = {
-        std::make_pair(colorAttachment, swapchainImage),
-    };
-
-    graphics.beginFrame(cmd, attachments, graphics.getSwapchainExtent());
-
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
     vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &set, 0, nullptr);
 
     // NOTE: Fullscreen quad that is made of clipped triangle. See quad vertex shader.
     vkCmdDraw(cmd, 3, 1, 0, 0);
-
-    graphics.endFrame(cmd);
 }
@@ -3,14 +3,14 @@
 
 #include <revival/vulkan/common.h>
 #include <revival/vulkan/resources.h>
-
-class VulkanGraphics;
+#include <revival/vulkan/graphics.h>
 
 class ShadowDebugPass
 {
 public:
     void init(VulkanGraphics &graphics, Buffer &vertexBuffer);
-    void shutdown(VkDevice device);
+    void createPipeline(VulkanGraphics &graphics);
+    void shutdown(VulkanGraphics &graphics);
 
     void render(VulkanGraphics &graphics, VkCommandBuffer cmd, Image &shadowMap);
 private:
@@ -19,5 +19,5 @@ private:
 
     VkDescriptorPool pool;
     VkDescriptorSetLayout setLayout;
-    VkDescriptorSet set;
+    std::array<VkDescriptorSet, FRAMES_IN_FLIGHT> sets;
 };
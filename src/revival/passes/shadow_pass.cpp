@@ -5,7 +5,7 @@
 #include <revival/vulkan/pipeline_builder.h>
 #include <revival/vulkan/descriptor_writer.h>
 
-void ShadowPass::init(VulkanGraphics &graphics, std::vector<Texture> &textures, std::vector<Light> &lights, Buffer &vertexBuffer)
+void ShadowPass::init(VulkanGraphics &graphics, std::vector<Light> &lights, Buffer &vertexBuffer, std::array<Buffer, FRAMES_IN_FLIGHT> &instanceBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &drawInstanceBuffers)
 {
     VkDevice device = graphics.getDevice();
 
@@ -13,43 +13,57 @@ void ShadowPass::init(VulkanGraphics &graphics, std::vector<Texture> &textures,
     // Create resources
     //
 
-    // create shadow map for every light
-    for (auto &light : lights) {
-        uint32_t shadowMapIndex = textures.size();
-        Texture &shadowMap = textures.emplace_back();
+    // create shadow map for every light, all of them share one sampler
+    SamplerDesc shadowSampler;
+    shadowSampler.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER;
 
-        graphics.createImage(shadowMap.image, shadowMapSize, shadowMapSize, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_BORDER);
+    for (auto &light : lights) {
+        Image shadowMap;
+        graphics.createImage(shadowMap, shadowMapSize, shadowMapSize, shadowMapFormat, VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT, shadowSampler);
 
-        light.shadowMapIndex = shadowMapIndex;
-        shadowMaps.push_back(shadowMap.image);
+        // render graph leaves shadow maps in shader read layout for the scene pass
+        light.shadowMapIndex = graphics.getTextureRegistry().add(shadowMap.view, shadowMap.sampler);
+        shadowMaps.push_back(shadowMap);
+        shadowMapSlots.push_back(light.shadowMapIndex);
     }
 
     //
-    // Descriptor set
+    // Descriptor sets (one per frame in flight)
     //
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1}, // vertices
+        {VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 * FRAMES_IN_FLIGHT}, // vertices, instances, draw instances
     };
 
     pool = vkutils::createDescriptorPool(device, poolSizes, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
 
     std::vector<VkDescriptorSetLayoutBinding> bindings = {
         {0, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT}, // vertices
+        {1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT}, // instances
+        {2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_VERTEX_BIT}, // draw instances
     };
-    VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT;
+    VkDescriptorBindingFlags bindingFlags[] = {VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT, VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT, VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT};
 
-    setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), &bindingFlags);
-    set = vkutils::createDescriptorSet(device, pool, setLayout);
+    setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), bindingFlags);
 
-    DescriptorWriter writer;
-    writer.write(0, vertexBuffer.buffer, vertexBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
-    writer.update(device, set);
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        sets[i] = vkutils::createDescriptorSet(device, pool, setLayout);
+
+        DescriptorWriter writer;
+        writer.write(0, vertexBuffer.buffer, vertexBuffer.size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(1, instanceBuffers[i].buffer, instanceBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.write(2, drawInstanceBuffers[i].buffer, drawInstanceBuffers[i].size, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER);
+        writer.update(device, sets[i]);
+    }
+}
+
+void ShadowPass::createPipeline(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
 
-    //
-    // Pipeline
-    //
     auto vertex = vkutils::loadShaderModule(device, "build/shaders/depth.vert.spv");
+    auto indirectVertex = vkutils::loadShaderModule(device, "build/shaders/depth_indirect.vert.spv");
     vkutils::setDebugName(device, (uint64_t)vertex, VK_OBJECT_TYPE_SHADER_MODULE, "depth.vert");
+    vkutils::setDebugName(device, (uint64_t)indirectVertex, VK_OBJECT_TYPE_SHADER_MODULE, "depth_indirect.vert");
 
     // create pipeline layout
     VkPushConstantRange pushConstant = {VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4)};
@@ -57,6 +71,8 @@ void ShadowPass::init(VulkanGraphics &graphics, std::vector<Texture> &textures,
 
     // create pipeline
     PipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setAttachmentFormats(VK_FORMAT_UNDEFINED, shadowMapFormat);
     builder.setPipelineLayout(layout);
     builder.setShader(vertex, VK_SHADER_STAGE_VERTEX_BIT);
     builder.setDepthTest(true);
@@ -66,53 +82,59 @@ void ShadowPass::init(VulkanGraphics &graphics, std::vector<Texture> &textures,
     pipeline = builder.build(device, 0, true);
     vkutils::setDebugName(device, (uint64_t)pipeline, VK_OBJECT_TYPE_PIPELINE, "shadow pipeline");
 
+    builder.clearShaders();
+    builder.setShader(indirectVertex, VK_SHADER_STAGE_VERTEX_BIT);
+    indirectPipeline = builder.build(device, 0, true);
+    vkutils::setDebugName(device, (uint64_t)indirectPipeline, VK_OBJECT_TYPE_PIPELINE, "shadow indirect pipeline");
+
     vkDestroyShaderModule(device, vertex, nullptr);
+    vkDestroyShaderModule(device, indirectVertex, nullptr);
 }
 
-void ShadowPass::shutdown(VkDevice device)
+void ShadowPass::shutdown(VulkanGraphics &graphics)
 {
-    vkDestroyPipelineLayout(device, layout, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyDescriptorPool(device, pool, nullptr);
-    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    for (size_t i = 0; i < shadowMaps.size(); i++) {
+        if (shadowMapSlots[i] != UINT32_MAX)
+            graphics.getTextureRegistry().remove(shadowMapSlots[i]);
+        graphics.destroyImage(shadowMaps[i]);
+    }
+
+    graphics.destroyPipeline(pipeline, layout);
+    graphics.destroyPipeline(indirectPipeline);
+    graphics.destroyDescriptors(pool, setLayout);
 }
 
-void ShadowPass::beginFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer, uint32_t lightIndex)
+VkCommandBuffer ShadowPass::beginSecondary(VulkanGraphics &graphics, uint32_t threadIndex)
 {
-    Image &shadowMap = shadowMaps[lightIndex];
+    VkCommandBufferInheritanceRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_RENDERING_INFO};
+    renderingInfo.depthAttachmentFormat = shadowMapFormat;
+    renderingInfo.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
 
-    VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    depthAttachment.clearValue.depthStencil = {0.0, 0};
-    depthAttachment.imageView = shadowMap.view;
-    depthAttachment.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+    VkCommandBuffer cmd = graphics.beginSecondaryCommandBuffer(threadIndex, renderingInfo);
 
-    std::vector<std::pair<VkRenderingAttachmentInfo, Image>> attachments = {
-        std::make_pair(depthAttachment, shadowMap),
-    };
+    vkutils::setViewport(cmd, 0.0f, 0.0f, shadowMapSize, shadowMapSize);
+    vkutils::setScissor(cmd, {shadowMapSize, shadowMapSize});
 
-    graphics.beginFrame(cmd, attachments, {shadowMapSize, shadowMapSize});
+    return cmd;
+}
 
+void ShadowPass::bind(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer)
+{
     vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &set, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &sets[graphics.getCurrentFrame()], 0, nullptr);
     vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
 }
 
-void ShadowPass::endFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, uint32_t lightIndex)
+void ShadowPass::bindIndirect(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer, mat4 lightMVP)
 {
-    Image &shadowMap = shadowMaps[lightIndex];
-
-    graphics.endFrame(cmd, false);
+    vkCmdSetDepthBias(cmd, depthBiasConstant, 0.0f, depthBiasSlope);
 
-    vkutils::insertImageBarrier(
-        cmd, shadowMap.handle,
-        VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
-        VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1});
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, indirectPipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &sets[graphics.getCurrentFrame()], 0, nullptr);
+    vkCmdBindIndexBuffer(cmd, indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+    vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4), &lightMVP);
 }
 
 void ShadowPass::render(VkCommandBuffer cmd, Scene &scene, mat4 lightMVP)
@@ -124,13 +146,24 @@ void ShadowPass::render(VkCommandBuffer cmd, Scene &scene, mat4 lightMVP)
     }
 }
 
-void ShadowPass::render(VkCommandBuffer cmd, GameObject &gameObject, mat4 lightMVP)
+void ShadowPass::render(VkCommandBuffer cmd, GameObject &gameObject, const Mesh &mesh, mat4 lightMVP, DrawState &state)
 {
-    if (!gameObject.scene) return;
-
-    lightMVP *= gameObject.transform.getModelMatrix();
-    for (auto &mesh : gameObject.scene->meshes) {
+    // meshes of one object are adjacent in the sorted draws and share the matrix
+    if (state.gameObject != &gameObject) {
+        lightMVP *= gameObject.transform.getModelMatrix();
         vkCmdPushConstants(cmd, layout, VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(mat4), &lightMVP);
-        vkCmdDrawIndexed(cmd, mesh.indexCount, 1, mesh.indexOffset, 0, 0);
+        state.gameObject = &gameObject;
+        state.pushConstants++;
+    } else {
+        state.skippedPushConstants++;
     }
+
+    vkCmdDrawIndexed(cmd, mesh.indexCount, 1, mesh.indexOffset, 0, 0);
+    state.draws++;
+}
+
+void ShadowPass::render(VkCommandBuffer cmd, const InstanceBatch &batch, DrawState &state)
+{
+    vkCmdDrawIndexed(cmd, batch.mesh->indexCount, batch.instanceCount, batch.mesh->indexOffset, 0, batch.firstInstance);
+    state.draws++;
 }
@@ -5,33 +5,50 @@
 #include <revival/types.h>
 
 #include <revival/game_object.h>
+#include <revival/draw_list.h>
 
 class VulkanGraphics;
 
 class ShadowPass
 {
 public:
-    void init(VulkanGraphics &graphics, std::vector<Texture> &textures, std::vector<Light> &lights, Buffer &vertexBuffer);
-    void shutdown(VkDevice device);
+    // creates a shadow map for every light and registers it in the bindless table (light.shadowMapIndex)
+    void init(VulkanGraphics &graphics, std::vector<Light> &lights, Buffer &vertexBuffer, std::array<Buffer, FRAMES_IN_FLIGHT> &instanceBuffers, std::array<Buffer, FRAMES_IN_FLIGHT> &drawInstanceBuffers);
+    void createPipeline(VulkanGraphics &graphics);
+    void shutdown(VulkanGraphics &graphics);
 
-    void beginFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer, uint32_t shadowMapIndex);
-    void endFrame(VulkanGraphics &graphics, VkCommandBuffer cmd, uint32_t shadowMapIndex);
+    // binds pipeline state, the shadow map has to be the current depth attachment
+    void bind(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer);
+    // same for the instance buffer pipeline, draws come from CullPass::drawIndirect or instanced batches
+    void bindIndirect(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer indexBuffer, mat4 lightMVP);
+
+    // secondary command buffer continuing the pass with viewport and scissor set, bind or bindIndirect it next.
+    // Thread safe per threadIndex.
+    VkCommandBuffer beginSecondary(VulkanGraphics &graphics, uint32_t threadIndex);
 
     void render(VkCommandBuffer cmd, Scene &scene, mat4 lightMVP);
-    void render(VkCommandBuffer cmd, GameObject &gameObject, mat4 lightMVP);
+    // one mesh of a game object, pushes only what differs from state
+    void render(VkCommandBuffer cmd, GameObject &gameObject, const Mesh &mesh, mat4 lightMVP, DrawState &state);
+    // instanced, after bindIndirect with the batch instances in the instance buffer
+    void render(VkCommandBuffer cmd, const InstanceBatch &batch, DrawState &state);
 
     Image &getShadowMapByLightIndex(uint32_t index) { return shadowMaps[index]; };
+    VkExtent2D getShadowMapExtent() { return {shadowMapSize, shadowMapSize}; };
 private:
     VkPipelineLayout layout;
     VkPipeline pipeline;
+    // model comes from the instance buffer, the push constant is only the light view projection
+    VkPipeline indirectPipeline;
 
     VkDescriptorPool pool;
     VkDescriptorSetLayout setLayout;
-    VkDescriptorSet set;
+    std::array<VkDescriptorSet, FRAMES_IN_FLIGHT> sets;
 
     const uint32_t shadowMapSize = 2048;
+    const VkFormat shadowMapFormat = VK_FORMAT_D32_SFLOAT;
     const float depthBiasConstant = 1.25f;
     const float depthBiasSlope = 1.75f;
 
     std::vector<Image> shadowMaps;
+    std::vector<uint32_t> shadowMapSlots;
 };
@@ -9,15 +9,17 @@ void SkyboxPass::init(VulkanGraphics &graphics, Texture &skybox)
 {
     VkDevice device = graphics.getDevice();
 
-    graphics.createBuffer(uboBuffer, sizeof(UBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-    vkutils::setDebugName(device, (uint64_t)uboBuffer.buffer, VK_OBJECT_TYPE_BUFFER, "skyboxUBO");
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        graphics.createBuffer(uboBuffers[i], sizeof(UBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryClass::Dynamic);
+        vkutils::setDebugName(device, (uint64_t)uboBuffers[i].buffer, VK_OBJECT_TYPE_BUFFER, ("skyboxUBO " + std::to_string(i)).c_str());
+    }
 
     //
-    // Descriptor set
+    // Descriptor sets (one per frame in flight)
     //
     std::vector<VkDescriptorPoolSize> poolSizes = {
-        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}, // ubo
-        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1}, // skybox
+        {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 * FRAMES_IN_FLIGHT}, // ubo
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 * FRAMES_IN_FLIGHT}, // skybox
     };
 
     pool = vkutils::createDescriptorPool(device, poolSizes);
@@ -28,16 +30,21 @@ void SkyboxPass::init(VulkanGraphics &graphics, Texture &skybox)
     };
 
     setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), nullptr);
-    set = vkutils::createDescriptorSet(device, pool, setLayout);
 
-    DescriptorWriter writer;
-    writer.write(0, uboBuffer.buffer, uboBuffer.size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
-    writer.write(1, skybox.image.view, skybox.image.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
-    writer.update(device, set);
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        sets[i] = vkutils::createDescriptorSet(device, pool, setLayout);
+
+        DescriptorWriter writer;
+        writer.write(0, uboBuffers[i].buffer, uboBuffers[i].size, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER);
+        writer.write(1, skybox.image.view, skybox.image.sampler, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER);
+        writer.update(device, sets[i]);
+    }
+}
+
+void SkyboxPass::createPipeline(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
 
-    //
-    // Pipeline
-    //
     auto vertex = vkutils::loadShaderModule(device, "build/shaders/skybox.vert.spv");
     auto fragment = vkutils::loadShaderModule(device, "build/shaders/skybox.frag.spv");
     vkutils::setDebugName(device, (uint64_t)vertex, VK_OBJECT_TYPE_SHADER_MODULE, "skybox.vert");
@@ -48,6 +55,8 @@ void SkyboxPass::init(VulkanGraphics &graphics, Texture &skybox)
 
     // create pipeline
     PipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setAttachmentFormats(graphics.getSwapchainFormat(), graphics.getDepthFormat());
     builder.setPipelineLayout(layout);
     builder.setShader(vertex, VK_SHADER_STAGE_VERTEX_BIT);
     builder.setShader(fragment, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -63,43 +72,27 @@ void SkyboxPass::init(VulkanGraphics &graphics, Texture &skybox)
     vkDestroyShaderModule(device, fragment, nullptr);
 }
 
-void SkyboxPass::shutdown(VulkanGraphics &graphics, VkDevice device)
+void SkyboxPass::shutdown(VulkanGraphics &graphics)
 {
-    graphics.destroyBuffer(uboBuffer);
+    for (auto &uboBuffer : uboBuffers)
+        graphics.destroyBuffer(uboBuffer);
 
-    vkDestroyPipelineLayout(device, layout, nullptr);
-    vkDestroyPipeline(device, pipeline, nullptr);
-    vkDestroyDescriptorPool(device, pool, nullptr);
-    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    graphics.destroyPipeline(pipeline, layout);
+    graphics.destroyDescriptors(pool, setLayout);
 }
 
 void SkyboxPass::render(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer &vertexBuffer, VkBuffer &indexBuffer, Camera &camera, Scene &cubeScene)
 {
+    uint32_t frame = graphics.getCurrentFrame();
+
     // update ubo
     UBO ubo = {};
     ubo.projection = camera.getProjection();
     ubo.view = camera.getView();
-    memcpy(uboBuffer.info.pMappedData, &ubo, sizeof(ubo));
-
-    Image swapchainImage = {};
-    swapchainImage.view = graphics.getSwapchainImageView();
-    swapchainImage.handle = graphics.getSwapchainImage();
-
-    VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
-    colorAttachment.imageView = swapchainImage.view;
-    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    std::vector<std::pair<VkRenderingAttachmentInfo, Image>> attachments = {
-        std::make_pair(colorAttachment, swapchainImage),
-    };
-
-    graphics.beginFrame(cmd, attachments, graphics.getSwapchainExtent());
+    memcpy(uboBuffers[frame].info.pMappedData, &ubo, sizeof(ubo));
 
     vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
-    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &set, 0, nullptr);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, layout, 0, 1, &sets[frame], 0, nullptr);
 
     VkDeviceSize offset = {0};
     vkCmdBindVertexBuffers(cmd, 0, 1, &vertexBuffer, &offset);
@@ -108,6 +101,4 @@ void SkyboxPass::render(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer
     for (auto &mesh : cubeScene.meshes) {
         vkCmdDrawIndexed(cmd, mesh.indexCount, 1, mesh.indexOffset, 0, 0);
     }
-
-    graphics.endFrame(cmd);
 }
@@ -2,16 +2,16 @@
 
 #include <revival/vulkan/common.h>
 #include <revival/vulkan/resources.h>
+#include <revival/vulkan/graphics.h>
 #include <revival/types.h>
 #include <revival/camera.h>
 
-class VulkanGraphics;
-
 class SkyboxPass
 {
 public:
     void init(VulkanGraphics &graphics, Texture &skybox);
-    void shutdown(VulkanGraphics &graphics, VkDevice device);
+    void createPipeline(VulkanGraphics &graphics);
+    void shutdown(VulkanGraphics &graphics);
 
     void render(VulkanGraphics &graphics, VkCommandBuffer cmd, VkBuffer &vertexBuffer, VkBuffer &indexBuffer, Camera &camera, Scene &cubeScene);
 private:
@@ -20,12 +20,12 @@ private:
 
     VkDescriptorPool pool;
     VkDescriptorSetLayout setLayout;
-    VkDescriptorSet set;
+    std::array<VkDescriptorSet, FRAMES_IN_FLIGHT> sets;
 
     struct UBO
     {
         mat4 projection;
         mat4 view;
     };
-    Buffer uboBuffer;
+    std::array<Buffer, FRAMES_IN_FLIGHT> uboBuffers;
 };
@@ -7,12 +7,13 @@ using namespace JPH;
 
 void DebugRendererImp::init(VulkanGraphics &graphics)
 {
-    VkDevice device = graphics.getDevice();
     this->graphics = &graphics;
+}
+
+void DebugRendererImp::createPipelines(VulkanGraphics &graphics)
+{
+    VkDevice device = graphics.getDevice();
 
-    //
-    // Pipelines
-    //
     auto vertexLine = vkutils::loadShaderModule(device, "build/shaders/debug_line.vert.spv");
     auto fragment = vkutils::loadShaderModule(device, "build/shaders/stub.frag.spv");
 
@@ -32,6 +33,8 @@ void DebugRendererImp::init(VulkanGraphics &graphics)
     // Line pipeline
     //
     PipelineBuilder builder;
+    builder.setPipelineCache(graphics.getPipelineCache());
+    builder.setAttachmentFormats(graphics.getSwapchainFormat(), graphics.getDepthFormat());
     builder.setPipelineLayout(line.layout);
     builder.setShader(vertexLine, VK_SHADER_STAGE_VERTEX_BIT);
     builder.setShader(fragment, VK_SHADER_STAGE_FRAGMENT_BIT);
@@ -13,6 +13,7 @@ class DebugRendererImp : public JPH::DebugRendererSimple
 {
 public:
     void init(VulkanGraphics &graphics);
+    void createPipelines(VulkanGraphics &graphics);
     void shutdown(VkDevice device);
 
     void setDrawState(VkCommandBuffer cmd);
@@ -1,4 +1,5 @@
 #include <revival/physics/physics.h>
+#include <revival/profiler.h>
 
 using namespace JPH;
 
@@ -17,7 +18,12 @@ bool Physics::init()
     tempAllocator = new TempAllocatorImpl(10 * 1024 * 1024);
 
     // We need a job system that will execute physics jobs on multiple threads.
-    jobSystem = new JobSystemThreadPool(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
+    // Worker threads are named in the cpu profiler, so the init function has to be set before threads are started.
+    jobSystem = new JobSystemThreadPool();
+    jobSystem->SetThreadInitFunction([](int threadIndex) {
+        profiler::registerThread(("Jolt " + std::to_string(threadIndex)).c_str());
+    });
+    jobSystem->Init(cMaxPhysicsJobs, cMaxPhysicsBarriers, thread::hardware_concurrency() - 1);
 
     physicsSystem.Init(maxBodies, numBodyMutexes, maxBodies, maxContactConstraints, broadPhaseLayerInterface, objectVsBroadPhaseLayerFilter, objectVsObjectFilter);
 
@@ -80,6 +86,8 @@ void Physics::createBox(RigidBody *body, Transform transform, vec3 halfExtent, b
 
 void Physics::update(float dt, std::vector<GameObject> &gameObjects)
 {
+    PROFILE_FUNCTION();
+
     BodyInterface &bodyInterface = physicsSystem.GetBodyInterface();
 
     float physicsDeltaTime = 1.0f / 60.0f;
@@ -98,8 +106,10 @@ void Physics::update(float dt, std::vector<GameObject> &gameObjects)
         }
     }
 
-    if (isActive)
+    if (isActive) {
+        PROFILE_SCOPE("PhysicsSystem::Update");
         physicsSystem.Update(physicsDeltaTime, 1, tempAllocator, jobSystem);
+    }
 }
 
 Transform Physics::getTransform(JPH::BodyID id)
@@ -0,0 +1,291 @@
+#include <revival/profiler.h>
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "imgui.h"
+
+namespace profiler
+{
+    struct Zone
+    {
+        const char *name;
+        uint64_t start; // nanoseconds since profiler epoch
+        uint64_t end;
+        uint32_t depth;
+        uint32_t thread;
+    };
+
+    // every thread writes only into its own buffer, the mutex is only contended while beginFrame gathers it
+    struct ThreadBuffer
+    {
+        std::mutex mutex;
+        std::string name;
+        uint32_t id;
+        std::vector<Zone> zones;
+        std::vector<uint32_t> openZones;
+    };
+
+    struct Frame
+    {
+        uint64_t start;
+        uint64_t end;
+        std::vector<Zone> zones;
+    };
+
+    static const auto epoch = std::chrono::steady_clock::now();
+
+    static std::mutex registryMutex;
+    static std::vector<std::unique_ptr<ThreadBuffer>> threads;
+    static thread_local ThreadBuffer *localBuffer = nullptr;
+
+    // ring buffer of finished frames
+    static std::vector<Frame> history;
+    static uint32_t historyNext = 0;
+    static uint64_t frameStart = 0;
+    static bool paused = false;
+    static int selectedFrame = 0; // 0 = latest, N = N frames back
+
+    static uint64_t now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+    }
+
+    static ThreadBuffer &getBuffer()
+    {
+        if (!localBuffer) {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            auto buffer = std::make_unique<ThreadBuffer>();
+            buffer->id = threads.size();
+            buffer->name = buffer->id == 0 ? "Main" : "Thread " + std::to_string(buffer->id);
+            localBuffer = buffer.get();
+            threads.push_back(std::move(buffer));
+        }
+
+        return *localBuffer;
+    }
+
+    void registerThread(const char *name)
+    {
+        ThreadBuffer &buffer = getBuffer();
+        std::lock_guard<std::mutex> lock(registryMutex);
+        buffer.name = name;
+    }
+
+    void beginZone(const char *name)
+    {
+        ThreadBuffer &buffer = getBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+
+        buffer.openZones.push_back(buffer.zones.size());
+        buffer.zones.push_back({name, now(), 0, static_cast<uint32_t>(buffer.openZones.size() - 1), buffer.id});
+    }
+
+    void endZone()
+    {
+        ThreadBuffer &buffer = getBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+
+        if (buffer.openZones.empty()) return;
+
+        buffer.zones[buffer.openZones.back()].end = now();
+        buffer.openZones.pop_back();
+    }
+
+    void beginFrame()
+    {
+        uint64_t frameEnd = now();
+
+        Frame frame;
+        frame.start = frameStart;
+        frame.end = frameEnd;
+        frameStart = frameEnd;
+
+        {
+            std::lock_guard<std::mutex> registryLock(registryMutex);
+            for (auto &buffer : threads) {
+                std::lock_guard<std::mutex> lock(buffer->mutex);
+
+                // finished zones go to the frame, open ones stay (in stack order) until they end in a later frame
+                std::vector<Zone> open;
+                for (auto &zone : buffer->zones) {
+                    if (zone.end == 0)
+                        open.push_back(zone);
+                    else
+                        frame.zones.push_back(zone);
+                }
+
+                buffer->zones = std::move(open);
+                for (uint32_t i = 0; i < buffer->openZones.size(); i++)
+                    buffer->openZones[i] = i;
+            }
+        }
+
+        if (paused) return;
+
+        if (history.size() < PROFILER_HISTORY) {
+            history.push_back(std::move(frame));
+        } else {
+            history[historyNext] = std::move(frame);
+        }
+        historyNext = (historyNext + 1) % PROFILER_HISTORY;
+    }
+
+    void setPaused(bool pause)
+    {
+        paused = pause;
+    }
+
+    static const Frame *getFrame(uint32_t framesBack)
+    {
+        if (framesBack >= history.size()) return nullptr;
+
+        uint32_t index = (historyNext + PROFILER_HISTORY - 1 - framesBack) % PROFILER_HISTORY;
+        return &history[index % history.size()];
+    }
+
+    void drawImGui()
+    {
+        ImGui::Checkbox("Pause", &paused);
+        if (paused && !history.empty()) {
+            ImGui::SameLine();
+            ImGui::SliderInt("Frames back", &selectedFrame, 0, history.size() - 1);
+        } else {
+            selectedFrame = 0;
+        }
+
+        const Frame *frame = getFrame(selectedFrame);
+        if (!frame) return;
+
+        double frameMs = (frame->end - frame->start) / 1000000.0;
+        ImGui::Text("CPU frame: %.3f ms", frameMs);
+
+        std::vector<std::pair<uint32_t, std::string>> threadNames;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (auto &buffer : threads)
+                threadNames.push_back({buffer->id, buffer->name});
+        }
+
+        // only threads with zones in this frame get a row, rows are as high as the deepest zone
+        std::vector<uint32_t> threadDepths(threadNames.size(), 0);
+        for (auto &zone : frame->zones) {
+            if (zone.thread < threadDepths.size())
+                threadDepths[zone.thread] = std::max(threadDepths[zone.thread], zone.depth + 1);
+        }
+
+        const float rowHeight = ImGui::GetTextLineHeight() + 4.0f;
+        const float labelWidth = 80.0f;
+
+        std::vector<float> threadOffsets(threadNames.size(), 0.0f);
+        float height = 0.0f;
+        for (uint32_t i = 0; i < threadNames.size(); i++) {
+            threadOffsets[i] = height;
+            if (threadDepths[i] > 0)
+                height += threadDepths[i] * rowHeight + 4.0f;
+        }
+        if (height == 0.0f) return;
+
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float width = std::max(ImGui::GetContentRegionAvail().x, labelWidth + 100.0f);
+        ImGui::InvisibleButton("timeline", ImVec2(width, height));
+        bool hovered = ImGui::IsItemHovered();
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+
+        ImDrawList *drawList = ImGui::GetWindowDrawList();
+        float timelineWidth = width - labelWidth;
+        double scale = timelineWidth / double(std::max<uint64_t>(frame->end - frame->start, 1));
+
+        for (uint32_t i = 0; i < threadNames.size(); i++) {
+            if (threadDepths[i] == 0) continue;
+            ImVec2 labelPos = ImVec2(origin.x, origin.y + threadOffsets[i] + 2.0f);
+            drawList->AddText(labelPos, IM_COL32(200, 200, 200, 255), threadNames[i].second.c_str());
+        }
+
+        const Zone *hoveredZone = nullptr;
+        for (auto &zone : frame->zones) {
+            if (zone.thread >= threadNames.size()) continue;
+
+            // zones that started in a previous frame are clamped to frame start
+            uint64_t start = std::max(zone.start, frame->start);
+            float x0 = origin.x + labelWidth + float((start - frame->start) * scale);
+            float x1 = origin.x + labelWidth + float((zone.end - frame->start) * scale);
+            x1 = std::max(x1, x0 + 1.0f);
+            float y0 = origin.y + threadOffsets[zone.thread] + zone.depth * rowHeight;
+            float y1 = y0 + rowHeight - 1.0f;
+
+            // stable color per name
+            uint32_t hash = 2166136261u;
+            for (const char *c = zone.name; *c; c++)
+                hash = (hash ^ uint8_t(*c)) * 16777619u;
+            ImU32 color = IM_COL32(80 + (hash & 0x7f), 80 + ((hash >> 8) & 0x7f), 80 + ((hash >> 16) & 0x7f), 255);
+
+            drawList->AddRectFilled(ImVec2(x0, y0), ImVec2(x1, y1), color);
+
+            if (x1 - x0 > ImGui::CalcTextSize(zone.name).x + 4.0f)
+                drawList->AddText(ImVec2(x0 + 2.0f, y0 + 2.0f), IM_COL32(0, 0, 0, 255), zone.name);
+
+            if (hovered && mouse.x >= x0 && mouse.x < x1 && mouse.y >= y0 && mouse.y < y1)
+                hoveredZone = &zone;
+        }
+
+        if (hoveredZone) {
+            ImGui::BeginTooltip();
+            ImGui::Text("%s", hoveredZone->name);
+            ImGui::Text("%.3f ms", (hoveredZone->end - hoveredZone->start) / 1000000.0);
+            ImGui::Text("%s", threadNames[hoveredZone->thread].second.c_str());
+            ImGui::EndTooltip();
+        }
+    }
+
+    static void writeEscaped(FILE *file, const char *text)
+    {
+        for (const char *c = text; *c; c++) {
+            if (*c == '"' || *c == '\\') fputc('\\', file);
+            fputc(*c, file);
+        }
+    }
+
+    bool saveChromeTrace(const char *path)
+    {
+        FILE *file = fopen(path, "w");
+        if (!file) {
+            printf("Failed to open file for writing - %s\n", path);
+            return false;
+        }
+
+        fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+        bool first = true;
+        {
+            std::lock_guard<std::mutex> lock(registryMutex);
+            for (auto &buffer : threads) {
+                fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"", first ? "" : ",\n", buffer->id);
+                writeEscaped(file, buffer->name.c_str());
+                fprintf(file, "\"}}");
+                first = false;
+            }
+        }
+
+        // oldest frame first, timestamps in microseconds
+        for (uint32_t framesBack = history.size(); framesBack-- > 0;) {
+            const Frame *frame = getFrame(framesBack);
+            for (auto &zone : frame->zones) {
+                fprintf(file, "%s{\"name\":\"", first ? "" : ",\n");
+                writeEscaped(file, zone.name);
+                fprintf(file, "\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", zone.thread, zone.start / 1000.0, (zone.end - zone.start) / 1000.0);
+                first = false;
+            }
+        }
+
+        fprintf(file, "\n]}\n");
+        fclose(file);
+
+        printf("Saved cpu trace of %zu frames to %s\n", history.size(), path);
+        return true;
+    }
+} // namespace profiler
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <stdint.h>
+
+// Scoped zone cpu profiler. Zones are recorded into thread local buffers and gathered once per frame,
+// the last PROFILER_HISTORY frames are kept so spikes can be dumped after they happen.
+//
+// Zone names must outlive the profiler (string literals or __func__).
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+
+#define PROFILE_SCOPE(name) profiler::Scope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+
+const uint32_t PROFILER_HISTORY = 300;
+
+namespace profiler
+{
+    // marks frame boundary, call once per frame from the main thread
+    void beginFrame();
+
+    // names the calling thread in the timeline, threads that never call it are named by their index
+    void registerThread(const char *name);
+
+    void beginZone(const char *name);
+    void endZone();
+
+    void setPaused(bool paused);
+
+    // timeline of the last finished frame
+    void drawImGui();
+
+    // writes the whole history in chrome://tracing (Trace Event Format) JSON
+    bool saveChromeTrace(const char *path);
+
+    struct Scope
+    {
+        Scope(const char *name) { beginZone(name); }
+        ~Scope() { endZone(); }
+    };
+} // namespace profiler
@@ -3,6 +3,7 @@
 #include <revival/scene_manager.h>
 #include <revival/vulkan/descriptor_writer.h>
 #include <revival/vulkan/pipeline_builder.h>
+#include <revival/profiler.h>
 
 #include "imgui.h"
 #include "backends/imgui_impl_glfw.h"
@@ -10,9 +11,14 @@
 
 #include <revival/physics/physics.h>
 
-bool Renderer::init(GLFWwindow *pWindow, Camera *pCamera, SceneManager *pSceneManager, GameManager *pGameManager, Globals *pGlobals)
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+
+bool Renderer::init(GLFWwindow *pWindow, Camera *pCamera, SceneManager *pSceneManager, GameManager *pGameManager, Globals *pGlobals, GraphicsSettings graphicsSettings)
 {
-    if (!pCamera || !pWindow || !pSceneManager || !pGameManager || !pGlobals) return false;
+    if (!pCamera || !pSceneManager || !pGameManager || !pGlobals) return false;
+    if (!pWindow && !graphicsSettings.headless) return false;
 
     window = pWindow;
     camera = pCamera;
@@ -20,24 +26,52 @@ bool Renderer::init(GLFWwindow *pWindow, Camera *pCamera, SceneManager *pSceneMa
     gameManager = pGameManager;
     globals = pGlobals;
 
-    graphics.init(window);
+    graphics.init(window, graphicsSettings);
+    const DeviceCapabilities &capabilities = graphics.getCapabilities();
+    gpuDrivenSupported = capabilities.multiDrawIndirect && capabilities.drawIndirectFirstInstance && capabilities.drawIndirectCount;
+    gpuDriven = gpuDrivenSupported;
+    jobSystem.init();
+    drawStates.resize(jobSystem.getThreadCount());
+    graphics.createThreadCommandPools(jobSystem.getThreadCount());
+    gpuProfiler.init(graphics);
+    renderGraph.init(graphics);
+
+    graphics.setMemoryBudgetCallback([](uint32_t heapIndex, VkDeviceSize usage, VkDeviceSize budget) {
+        printf("Memory heap %u is close to its budget: %.1f / %.1f MB\n", heapIndex, usage / (1024.0 * 1024.0), budget / (1024.0 * 1024.0));
+    });
 
     createResources();
 
     auto &billboards = sceneManager->getBillboards();
 
     // set cacodemon texture to all billboards :D
+    uint32_t cacodemonIndex = sceneManager->getTextureIndexByFilename("textures/cacodemon.png");
     for (auto &billboard : billboards) {
-        billboard.textureIndex = sceneManager->getTextureIndexByFilename("textures/cacodemon.png");
+        billboard.textureIndex = sceneManager->getTextureByIndex(cacodemonIndex).slot;
     }
 
-    auto &textures = sceneManager->getTextures();
-
-    shadowPass.init(graphics, textures, sceneManager->getLights(), vertexBuffer);
+    depthPyramidPass.init(graphics);
+    cullPass.init(graphics, depthPyramidPass.getImage());
+    shadowPass.init(graphics, sceneManager->getLights(), vertexBuffer, cullPass.getInstanceBuffers(), cullPass.getDrawInstanceBuffers());
     shadowDebugPass.init(graphics, vertexBuffer);
-    scenePass.init(graphics, textures, vertexBuffer, uboBuffer, materialsBuffer, lightsBuffer);
+    scenePass.init(graphics, vertexBuffer, uboBuffers, materialsBuffers, lightsBuffers, cullPass.getInstanceBuffers(), cullPass.getDrawInstanceBuffers());
     skyboxPass.init(graphics, skybox);
-    billboardPass.init(graphics, textures);
+    billboardPass.init(graphics);
+
+    // compile pipelines on the worker pool, they only share the pipeline cache which is internally synchronized
+    auto pipelinesStart = std::chrono::high_resolution_clock::now();
+
+    jobSystem.execute([this] { cullPass.createPipeline(graphics); });
+    jobSystem.execute([this] { depthPyramidPass.createPipeline(graphics); });
+    jobSystem.execute([this] { shadowPass.createPipeline(graphics); });
+    jobSystem.execute([this] { shadowDebugPass.createPipeline(graphics); });
+    jobSystem.execute([this] { scenePass.createPipeline(graphics); });
+    jobSystem.execute([this] { skyboxPass.createPipeline(graphics); });
+    jobSystem.execute([this] { billboardPass.createPipeline(graphics); });
+    jobSystem.wait();
+
+    float pipelinesTime = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - pipelinesStart).count();
+    printf("Pipelines created in %.2f ms (%s pipeline cache)\n", pipelinesTime, graphics.isPipelineCacheWarm() ? "warm" : "cold");
 
     return true;
 }
@@ -48,9 +82,12 @@ void Renderer::shutdown()
     VkDevice device = graphics.getDevice();
 
     // Resources
-    graphics.destroyBuffer(uboBuffer);
-    graphics.destroyBuffer(materialsBuffer);
-    graphics.destroyBuffer(lightsBuffer);
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        graphics.destroyBuffer(uboBuffers[i]);
+        graphics.destroyBuffer(materialsBuffers[i]);
+        if (lightsBuffers[i].size > 0)
+            graphics.destroyBuffer(lightsBuffers[i]);
+    }
 
     graphics.destroyBuffer(vertexBuffer);
     graphics.destroyBuffer(indexBuffer);
@@ -62,52 +99,184 @@ void Renderer::shutdown()
     graphics.destroyTexture(skybox);
 
     // Passes
-    shadowPass.shutdown(device);
-    shadowDebugPass.shutdown(device);
-    scenePass.shutdown(device);
-    skyboxPass.shutdown(graphics, device);
-    billboardPass.shutdown(graphics, device);
-
+    cullPass.shutdown(graphics);
+    depthPyramidPass.shutdown(graphics);
+    shadowPass.shutdown(graphics);
+    shadowDebugPass.shutdown(graphics);
+    scenePass.shutdown(graphics);
+    skyboxPass.shutdown(graphics);
+    billboardPass.shutdown(graphics);
+
+    jobSystem.shutdown();
+    gpuProfiler.shutdown(device);
+    renderGraph.shutdown();
     graphics.shutdown();
 }
 
 void Renderer::render()
 {
-    updateDynamicBuffers();
+    PROFILE_FUNCTION();
 
+    // NOTE: beginCommandBuffer waits for the fence of the current frame, only after that its buffers are free to write
     VkCommandBuffer cmd = graphics.beginCommandBuffer();
+
+    gpuProfiler.beginFrame(cmd, graphics.getCurrentFrame());
+    gpuProfiler.beginScope(cmd, "Frame");
+
+    updateDynamicBuffers();
     uint32_t scenesCount = sceneManager->getScenes().size();
+    // shadows are cast by light 0 only, a scene without lights skips them
+    bool hasLight = !sceneManager->getLights().empty();
+
+    for (auto &state : drawStates)
+        state = {};
+
+    // both paths start from the objects in the frustum of the camera or a light
+    if (scenesCount > 0) {
+        std::vector<mat4> viewProjections = {camera->getProjection() * camera->getView()};
+        for (auto &light : sceneManager->getLights())
+            viewProjections.push_back(light.mvp);
+
+        frustumCuller.update(gameManager->getGameObjects());
+        if (frustumCulling)
+            frustumCuller.cull(jobSystem, viewProjections);
+        else
+            frustumCuller.cullNone(viewProjections.size());
+    }
+
+    // culling runs on the compute queue while the frame is recorded, draws wait for it at the indirect stage
+    if (gpuDriven && scenesCount > 0) {
+        if (depthPyramidPass.resize(graphics, graphics.getSwapchainExtent()))
+            depthPyramidRecreated = true;
+        cullPass.setDepthPyramid(graphics, depthPyramidPass.getImage(), depthPyramidPass.getExtent());
+
+        // only objects in the camera or shadow frustum become instances, the GPU culls them per view
+        std::vector<uint32_t> &cameraVisible = frustumCuller.getVisible(0);
+        if (hasLight) {
+            std::vector<uint32_t> &lightVisible = frustumCuller.getVisible(1);
+            gpuCullObjects.clear();
+            std::set_union(cameraVisible.begin(), cameraVisible.end(), lightVisible.begin(), lightVisible.end(), std::back_inserter(gpuCullObjects));
+            cullPass.update(graphics, gameManager->getGameObjects(), gpuCullObjects, camera->getPosition());
+        } else {
+            cullPass.update(graphics, gameManager->getGameObjects(), cameraVisible, camera->getPosition());
+        }
 
-    // XXX: right now every pass should specify load and store ops appropriately inside the classes, based on other passes.
-    // maybe it would be better to give them as parameters?
+        // without a light the shadow view is culled against identity, its draws are never used
+        mat4 shadowVP = hasLight ? sceneManager->getLightByIndex(0).mvp : mat4(1.0f);
+        cullPass.execute(graphics, camera->getProjection() * camera->getView(), shadowVP, occlusionCulling);
+    } else if (scenesCount > 0) {
+        // the GPU driven path fills the same buffer, only one of them runs in a frame
+        if (instancing) {
+            uint32_t frame = graphics.getCurrentFrame();
+            instanceBatcher.begin(cullPass.getInstanceBuffers()[frame], &cullPass.getDrawInstanceBuffers()[frame], MAX_GPU_INSTANCES);
+            instanceBatcher.build(gameManager->getGameObjects(), frustumCuller.getVisible(0), camera->getPosition(), sceneBatches);
+            if (hasLight)
+                instanceBatcher.build(gameManager->getGameObjects(), frustumCuller.getVisible(1), sceneManager->getLightByIndex(0).position, shadowBatches);
+            else
+                shadowBatches.clear();
+        }
+
+        buildDrawLists();
+    }
+
+    renderGraph.reset();
+
+    // swapchain contents are discarded on acquire, the first write waits for the acquire semaphore stage
+    RenderGraph::ResourceState acquired = {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, 0};
+    RGImage swapchain = renderGraph.importImage("Swapchain", graphics.getSwapchainImage(), graphics.getSwapchainImageView(), graphics.getSwapchainExtent(), VK_IMAGE_ASPECT_COLOR_BIT, acquired);
+    RGImage depth = renderGraph.createImage("Depth", graphics.getSwapchainExtent(), graphics.getDepthFormat(), VK_IMAGE_ASPECT_DEPTH_BIT);
+    RGImage shadowMap;
+    Image *shadowMapImage = nullptr;
+    if (hasLight) {
+        shadowMapImage = &shadowPass.getShadowMapByLightIndex(0);
+        shadowMap = renderGraph.importImage("Shadow map", shadowMapImage->handle, shadowMapImage->view, shadowPass.getShadowMapExtent(), VK_IMAGE_ASPECT_DEPTH_BIT);
+    }
+
+    renderGraph.setOutput(swapchain, graphics.getPresentLayout());
+
+    // written by the early culling on the compute queue, which the frame waits for
+    RGBuffer draws = renderGraph.importBuffer("Draws", cullPass.getDrawBuffer(graphics.getCurrentFrame()));
+    RGBuffer drawCounts = renderGraph.importBuffer("Draw counts", cullPass.getCountBuffer(graphics.getCurrentFrame()));
+    RGBuffer drawInstances = renderGraph.importBuffer("Draw instances", cullPass.getDrawInstanceBuffers()[graphics.getCurrentFrame()]);
 
     //
     // Skybox Pass
     //
     if (scenesCount > 0)
     {
-        vkutils::beginDebugLabel(cmd, "Skybox", {0.3, 0.6, 0.3, 1.0});
-        skyboxPass.render(graphics, cmd, vertexBuffer.buffer, indexBuffer.buffer, *camera, sceneManager->getSceneByName("cube"));
-        vkutils::endDebugLabel(cmd);
+        RenderGraph::Pass &pass = renderGraph.addPass("Skybox", {0.3, 0.6, 0.3, 1.0});
+        pass.writeColor(swapchain, true);
+        pass.setExecute([&](VkCommandBuffer cmd) {
+            skyboxPass.render(graphics, cmd, vertexBuffer.buffer, indexBuffer.buffer, *camera, sceneManager->getSceneByName("cube"));
+        });
     }
 
     //
     // Shadow Pass
     //
-    if (scenesCount > 0)
+    if (scenesCount > 0 && hasLight)
     {
-        vkutils::beginDebugLabel(cmd, "Shadow", {0.3, 0.3, 0.3, 0.5});
-        shadowPass.beginFrame(graphics, cmd, indexBuffer.buffer, 0);
+        RenderGraph::Pass &pass = renderGraph.addPass("Shadow", {0.3, 0.3, 0.3, 0.5});
+        pass.writeDepth(shadowMap, true);
+        if (gpuDriven) {
+            pass.read(draws, BufferUsage::IndirectBuffer);
+            pass.read(drawCounts, BufferUsage::IndirectBuffer);
+            pass.read(drawInstances, BufferUsage::StorageGraphics);
+        }
+        if (parallelRecording && !gpuDriven)
+            pass.setRenderingFlags(VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT);
 
-        mat4 lightMVP = sceneManager->getLightByIndex(0).mvp;
+        pass.setExecute([&](VkCommandBuffer cmd) {
+            mat4 lightMVP = sceneManager->getLightByIndex(0).mvp;
 
-        auto &gameObjects = gameManager->getGameObjects();
-        for (auto &object : gameObjects) {
-            shadowPass.render(cmd, object, lightMVP);
-        }
+            DrawState &state = drawStates[0];
+            state.reset();
 
-        shadowPass.endFrame(graphics, cmd, 0);
-        vkutils::endDebugLabel(cmd);
+            if (gpuDriven) {
+                shadowPass.bindIndirect(graphics, cmd, indexBuffer.buffer, lightMVP);
+                state.binds++;
+                cullPass.drawIndirect(graphics, cmd, CULL_VIEW_SHADOW);
+                state.draws++;
+                return;
+            }
+
+            auto &items = shadowDrawList.getItems();
+            if (parallelRecording) {
+                recordParallel(cmd, items.size(),
+                    [&](uint32_t threadIndex) {
+                        VkCommandBuffer secondary = shadowPass.beginSecondary(graphics, threadIndex);
+                        if (instancing)
+                            shadowPass.bindIndirect(graphics, secondary, indexBuffer.buffer, lightMVP);
+                        else
+                            shadowPass.bind(graphics, secondary, indexBuffer.buffer);
+                        drawStates[threadIndex].reset();
+                        drawStates[threadIndex].binds++;
+                        return secondary;
+                    },
+                    [&](VkCommandBuffer secondary, uint32_t i) {
+                        DrawState &threadState = drawStates[JobSystem::getThreadIndex()];
+                        if (instancing) {
+                            shadowPass.render(secondary, shadowBatches[items[i].index], threadState);
+                        } else {
+                            ObjectDraw &draw = shadowDraws[items[i].index];
+                            shadowPass.render(secondary, *draw.gameObject, *draw.mesh, lightMVP, threadState);
+                        }
+                    });
+            } else if (instancing) {
+                shadowPass.bindIndirect(graphics, cmd, indexBuffer.buffer, lightMVP);
+                state.binds++;
+                for (auto &item : items) {
+                    shadowPass.render(cmd, shadowBatches[item.index], state);
+                }
+            } else {
+                shadowPass.bind(graphics, cmd, indexBuffer.buffer);
+                state.binds++;
+                for (auto &item : items) {
+                    ObjectDraw &draw = shadowDraws[item.index];
+                    shadowPass.render(cmd, *draw.gameObject, *draw.mesh, lightMVP, state);
+                }
+            }
+        });
     }
 
     //
@@ -115,73 +284,229 @@ void Renderer::render()
     //
     if (scenesCount > 0)
     {
-        vkutils::beginDebugLabel(cmd, "Scenes");
-        scenePass.beginFrame(graphics, cmd, indexBuffer.buffer);
-
-        auto &gameObjects = gameManager->getGameObjects();
-        for (auto &object : gameObjects) {
-            scenePass.render(cmd, object);
+        RenderGraph::Pass &pass = renderGraph.addPass("Scenes");
+        pass.writeColor(swapchain);
+        pass.writeDepth(depth, true);
+        if (hasLight)
+            pass.read(shadowMap, ImageUsage::SampledFragment);
+        if (gpuDriven) {
+            pass.read(draws, BufferUsage::IndirectBuffer);
+            pass.read(drawCounts, BufferUsage::IndirectBuffer);
+            pass.read(drawInstances, BufferUsage::StorageGraphics);
         }
+        if (parallelRecording && !gpuDriven)
+            pass.setRenderingFlags(VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT);
+
+        pass.setExecute([&](VkCommandBuffer cmd) {
+            DrawState &state = drawStates[0];
+            state.reset();
+
+            if (gpuDriven) {
+                scenePass.bindIndirect(graphics, cmd, indexBuffer.buffer);
+                state.binds++;
+                cullPass.drawIndirect(graphics, cmd, CULL_VIEW_SCENE);
+                state.draws++;
+                return;
+            }
 
-        scenePass.endFrame(graphics, cmd);
-        vkutils::endDebugLabel(cmd);
+            auto &items = sceneDrawList.getItems();
+            if (parallelRecording) {
+                recordParallel(cmd, items.size(),
+                    [&](uint32_t threadIndex) {
+                        VkCommandBuffer secondary = scenePass.beginSecondary(graphics, threadIndex);
+                        if (instancing)
+                            scenePass.bindIndirect(graphics, secondary, indexBuffer.buffer);
+                        else
+                            scenePass.bind(graphics, secondary, indexBuffer.buffer);
+                        drawStates[threadIndex].reset();
+                        drawStates[threadIndex].binds++;
+                        return secondary;
+                    },
+                    [&](VkCommandBuffer secondary, uint32_t i) {
+                        DrawState &threadState = drawStates[JobSystem::getThreadIndex()];
+                        if (instancing) {
+                            scenePass.render(secondary, sceneBatches[items[i].index], threadState);
+                        } else {
+                            ObjectDraw &draw = sceneDraws[items[i].index];
+                            scenePass.render(secondary, *draw.gameObject, *draw.mesh, threadState);
+                        }
+                    });
+            } else if (instancing) {
+                scenePass.bindIndirect(graphics, cmd, indexBuffer.buffer);
+                state.binds++;
+                for (auto &item : items) {
+                    scenePass.render(cmd, sceneBatches[item.index], state);
+                }
+            } else {
+                scenePass.bind(graphics, cmd, indexBuffer.buffer);
+                state.binds++;
+                for (auto &item : items) {
+                    ObjectDraw &draw = sceneDraws[item.index];
+                    scenePass.render(cmd, *draw.gameObject, *draw.mesh, state);
+                }
+            }
+        });
     }
 
-    // Billboard Pass
+    //
+    // Occlusion culling, late phase
+    //
+    if (scenesCount > 0 && gpuDriven && occlusionCulling)
     {
-        vkutils::beginDebugLabel(cmd, "Billboards", {0.3, 0.0, 0.0, 0.5});
-        billboardPass.beginFrame(graphics, cmd, *camera);
+        Image &pyramidImage = depthPyramidPass.getImage();
+        // the graph knows the state of the old image under the same handle, a new one starts undefined
+        RenderGraph::ResourceState created = {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, 0};
+        RGImage pyramid = depthPyramidRecreated
+            ? renderGraph.importImage("Depth pyramid", pyramidImage.handle, pyramidImage.view, depthPyramidPass.getExtent(), VK_IMAGE_ASPECT_COLOR_BIT, created)
+            : renderGraph.importImage("Depth pyramid", pyramidImage.handle, pyramidImage.view, depthPyramidPass.getExtent(), VK_IMAGE_ASPECT_COLOR_BIT);
+        depthPyramidRecreated = false;
+
+        {
+            RenderGraph::Pass &pass = renderGraph.addPass("Depth pyramid", {0.3, 0.3, 0.6, 1.0});
+            pass.read(depth, ImageUsage::SampledCompute);
+            pass.write(pyramid, ImageUsage::StorageCompute);
+            pass.setExecute([&](VkCommandBuffer cmd) {
+                depthPyramidPass.render(graphics, cmd, renderGraph.getImageView(depth), graphics.getSwapchainExtent());
+            });
+        }
 
-        auto &billboards = sceneManager->getBillboards();
-        for (auto &billboard : billboards) {
-            billboardPass.render(cmd, graphics.getDevice(), billboard.position, billboard.size, billboard.textureIndex);
+        {
+            RenderGraph::Pass &pass = renderGraph.addPass("Late cull", {0.6, 0.3, 0.0, 1.0});
+            pass.read(pyramid, ImageUsage::SampledCompute);
+            pass.write(draws, BufferUsage::StorageCompute);
+            pass.write(drawInstances, BufferUsage::StorageCompute);
+            pass.setExecute([&](VkCommandBuffer cmd) {
+                cullPass.executeLate(graphics, cmd);
+            });
         }
 
-        billboardPass.endFrame(graphics, cmd);
-        vkutils::endDebugLabel(cmd);
+        {
+            RenderGraph::Pass &pass = renderGraph.addPass("Scenes late");
+            pass.writeColor(swapchain);
+            pass.writeDepth(depth);
+            if (hasLight)
+                pass.read(shadowMap, ImageUsage::SampledFragment);
+            pass.read(draws, BufferUsage::IndirectBuffer);
+            pass.read(drawCounts, BufferUsage::IndirectBuffer);
+            pass.read(drawInstances, BufferUsage::StorageGraphics);
+            pass.setExecute([&](VkCommandBuffer cmd) {
+                scenePass.bindIndirect(graphics, cmd, indexBuffer.buffer);
+                cullPass.drawIndirect(graphics, cmd, CULL_VIEW_SCENE_LATE);
+                drawStates[0].binds++;
+                drawStates[0].draws++;
+            });
+        }
+    }
+
+    // Billboard Pass
+    {
+        RenderGraph::Pass &pass = renderGraph.addPass("Billboards", {0.3, 0.0, 0.0, 0.5});
+        pass.writeColor(swapchain);
+        pass.setExecute([&](VkCommandBuffer cmd) {
+            billboardPass.bind(graphics, cmd, *camera);
+
+            auto &billboards = sceneManager->getBillboards();
+            for (auto &billboard : billboards) {
+                billboardPass.render(cmd, graphics.getDevice(), billboard.position, billboard.size, billboard.textureIndex);
+            }
+        });
     }
 
     //
     // Shadow Debug Pass (Fullscreen quad)
     //
-    if (debugLightDepth)
+    if (debugLightDepth && hasLight)
     {
-        vkutils::beginDebugLabel(cmd, "Shadow debug");
-        shadowDebugPass.render(graphics, cmd, shadowPass.getShadowMapByLightIndex(0));
-        vkutils::endDebugLabel(cmd);
+        RenderGraph::Pass &pass = renderGraph.addPass("Shadow debug");
+        pass.writeColor(swapchain);
+        pass.read(shadowMap, ImageUsage::SampledFragment);
+        pass.setExecute([&](VkCommandBuffer cmd) {
+            shadowDebugPass.render(graphics, cmd, *shadowMapImage);
+        });
     }
 
     // Imgui Pass
-    if (globals->showImGui)
+    if (globals->showImGui && !graphics.isHeadless())
     {
-        vkutils::beginDebugLabel(cmd, "Dear ImGUI", {0.3, 0.3, 0.0, 0.5});
-        renderImgui(cmd);
-        vkutils::endDebugLabel(cmd);
+        RenderGraph::Pass &pass = renderGraph.addPass("Dear ImGUI", {0.3, 0.3, 0.0, 0.5});
+        pass.writeColor(swapchain);
+        pass.setExecute([&](VkCommandBuffer cmd) {
+            renderImgui(cmd);
+        });
     }
 
+    renderGraph.execute(cmd, &gpuProfiler);
+
+    gpuProfiler.endScope(cmd);
+
     graphics.endCommandBuffer(cmd);
     graphics.submitCommandBuffer(cmd);
 }
 
-void Renderer::renderImgui(VkCommandBuffer cmd)
+void Renderer::buildDrawLists()
 {
-    Image swapchainImage;
-    swapchainImage.view = graphics.getSwapchainImageView();
-    swapchainImage.handle = graphics.getSwapchainImage();
-
-    VkRenderingAttachmentInfo colorAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    colorAttachment.clearValue.color = {{0.0, 0.0, 0.0, 1.0}};
-    colorAttachment.imageView = swapchainImage.view;
-    colorAttachment.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    colorAttachment.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    std::vector<std::pair<VkRenderingAttachmentInfo, Image>> attachments = {
-        std::make_pair(colorAttachment, swapchainImage),
+    PROFILE_FUNCTION();
+
+    auto &gameObjects = gameManager->getGameObjects();
+
+    // one pipeline per pass and path, shadows have no material so they sort by depth only
+    auto build = [&](DrawList &list, std::vector<ObjectDraw> &draws, std::vector<InstanceBatch> &batches, uint32_t view, vec3 eye, bool materials) {
+        list.clear();
+        draws.clear();
+
+        if (instancing) {
+            for (uint32_t i = 0; i < batches.size(); i++)
+                list.add(DrawList::makeKey(DRAW_PASS_OPAQUE, 0, materials ? batches[i].mesh->materialIndex : -1, batches[i].depth), i);
+        } else {
+            for (uint32_t index : frustumCuller.getVisible(view)) {
+                GameObject &gameObject = gameObjects[index];
+                if (!gameObject.scene) continue;
+
+                float depth = glm::length(gameObject.sphere.center - eye) - gameObject.sphere.radius;
+                for (auto &mesh : gameObject.scene->meshes) {
+                    list.add(DrawList::makeKey(DRAW_PASS_OPAQUE, 0, materials ? mesh.materialIndex : -1, depth), draws.size());
+                    draws.push_back({&gameObject, &mesh});
+                }
+            }
+        }
+
+        list.sort();
     };
 
-    graphics.beginFrame(cmd, attachments, graphics.getSwapchainExtent());
+    build(sceneDrawList, sceneDraws, sceneBatches, 0, camera->getPosition(), true);
+    if (!sceneManager->getLights().empty()) {
+        build(shadowDrawList, shadowDraws, shadowBatches, 1, sceneManager->getLightByIndex(0).position, false);
+    } else {
+        shadowDrawList.clear();
+        shadowDraws.clear();
+    }
+}
+
+void Renderer::recordParallel(VkCommandBuffer cmd, uint32_t count, std::function<VkCommandBuffer(uint32_t threadIndex)> begin, std::function<void(VkCommandBuffer secondary, uint32_t index)> record)
+{
+    if (count == 0) return;
+
+    // one secondary buffer per group, indexed by group so they execute in the same order as a serial loop would record
+    uint32_t groupCount = (count + RECORD_GROUP_SIZE - 1) / RECORD_GROUP_SIZE;
+    std::vector<VkCommandBuffer> secondaries(groupCount);
+
+    jobSystem.dispatch(count, RECORD_GROUP_SIZE, [&](uint32_t first, uint32_t last) {
+        PROFILE_SCOPE("Record secondary");
+
+        VkCommandBuffer secondary = begin(JobSystem::getThreadIndex());
+        for (uint32_t i = first; i < last; i++)
+            record(secondary, i);
+        VK_CHECK(vkEndCommandBuffer(secondary));
+
+        secondaries[first / RECORD_GROUP_SIZE] = secondary;
+    });
+    jobSystem.wait();
 
+    vkCmdExecuteCommands(cmd, secondaries.size(), secondaries.data());
+}
+
+void Renderer::renderImgui(VkCommandBuffer cmd)
+{
     ImGui_ImplVulkan_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
@@ -190,8 +515,28 @@ void Renderer::renderImgui(VkCommandBuffer cmd)
 
     {
         ImGui::Begin("Debug");
+        ImGui::Text("GPU: %s", graphics.getCapabilities().name);
+        ImGui::Text("Frame time: %.2f ms (%.0f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+
+        // switching recreates the swapchain on the next frame
+        const char *presentModeNames[] = {"Immediate", "Mailbox", "FIFO", "FIFO relaxed"};
+        VkPresentModeKHR currentPresentMode = graphics.getPresentMode();
+        if (currentPresentMode <= VK_PRESENT_MODE_FIFO_RELAXED_KHR && ImGui::BeginCombo("Present mode", presentModeNames[currentPresentMode])) {
+            for (VkPresentModeKHR mode : graphics.getSupportedPresentModes()) {
+                if (mode > VK_PRESENT_MODE_FIFO_RELAXED_KHR) continue;
+
+                if (ImGui::Selectable(presentModeNames[mode], mode == currentPresentMode))
+                    graphics.setPresentMode(mode);
+            }
+            ImGui::EndCombo();
+        }
+
         ImGui::Text("Verices: %zu", sceneManager->getVertices().size());
         ImGui::Text("Textures: %zu", sceneManager->getTextures().size());
+        ImGui::Text("Samplers: %u", graphics.getSamplerCount());
+        ImGui::Text("Async compute: %s", graphics.hasAsyncCompute() ? "yes" : "no");
+        TextureRegistry &textureRegistry = graphics.getTextureRegistry();
+        ImGui::Text("Bindless slots: %u / %u (up to %u)", textureRegistry.getCount(), textureRegistry.getCapacity(), textureRegistry.getMaxCapacity());
         ImGui::Text("Materials: %zu", sceneManager->getMaterials().size());
         ImGui::Text("Scenes: %zu", sceneManager->getScenes().size());
         ImGui::Text("Lights: %zu", sceneManager->getLights().size());
@@ -199,6 +544,44 @@ void Renderer::renderImgui(VkCommandBuffer cmd)
         ImGui::Text("Game Objects: %zu", gameManager->getGameObjects().size());
 
         ImGui::Checkbox("Debug depth", &debugLightDepth);
+        ImGui::Checkbox("Parallel recording", &parallelRecording);
+        if (gpuDrivenSupported)
+            ImGui::Checkbox("GPU driven", &gpuDriven);
+        else
+            ImGui::Text("GPU driven: not supported by the device");
+        ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+        ImGui::Text("GPU instances: %u in %u instanced draws", cullPass.getInstanceCount(), cullPass.getDrawCount());
+        ImGui::Checkbox("Frustum culling", &frustumCulling);
+        ImGui::Checkbox("Instancing", &instancing);
+
+        DrawState frameState;
+        for (auto &state : drawStates) {
+            frameState.draws += state.draws;
+            frameState.binds += state.binds;
+            frameState.pushConstants += state.pushConstants;
+            frameState.skippedPushConstants += state.skippedPushConstants;
+        }
+        ImGui::Text("Draw calls: %u, binds: %u, push constants: %u (%u skipped)", frameState.draws, frameState.binds, frameState.pushConstants, frameState.skippedPushConstants);
+        if (!gpuDriven && instancing)
+            ImGui::Text("Instanced draws: %zu scene, %zu shadow (%u instances)", sceneBatches.size(), shadowBatches.size(), instanceBatcher.getInstanceCount());
+        // the GPU driven path only makes instances of objects visible in the camera or the shadow view
+        uint32_t objectCount = frustumCuller.getObjectCount();
+        for (uint32_t view = 0; view < frustumCuller.getViewCount(); view++) {
+            uint32_t visibleCount = frustumCuller.getVisible(view).size();
+            if (view == 0)
+                ImGui::Text("Camera: %u visible, %u culled", visibleCount, objectCount - visibleCount);
+            else
+                ImGui::Text("Light %u: %u visible, %u culled", view - 1, visibleCount, objectCount - visibleCount);
+        }
+
+        if (ImGui::CollapsingHeader("GPU timings", ImGuiTreeNodeFlags_DefaultOpen))
+            gpuProfiler.drawImGui();
+        if (ImGui::CollapsingHeader("CPU timeline"))
+            profiler::drawImGui();
+        if (ImGui::CollapsingHeader("Render graph"))
+            renderGraph.drawImGui();
+        if (ImGui::CollapsingHeader("Memory"))
+            graphics.drawMemoryImGui();
         ImGui::End();
     }
 
@@ -236,8 +619,6 @@ void Renderer::renderImgui(VkCommandBuffer cmd)
 
     ImGui::Render();
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), cmd);
-
-    graphics.endFrame(cmd);
 }
 
 void Renderer::createResources()
@@ -252,6 +633,15 @@ void Renderer::createResources()
     }
     sceneManager->addTexture(graphics, "textures/cacodemon.png");
 
+    // materials reference textures in load order, shaders index the bindless table
+    auto &textures = sceneManager->getTextures();
+    for (auto &material : sceneManager->getMaterials()) {
+        for (int *id : {&material.albedoId, &material.specularId, &material.normalId, &material.emissiveId}) {
+            if (*id > -1)
+                *id = textures[*id].slot;
+        }
+    }
+
     // load skybox texture
     graphics.createTextureCubemap(skybox, "textures/skybox", VK_FORMAT_R8G8B8A8_SRGB);
 
@@ -261,35 +651,50 @@ void Renderer::createResources()
 
     uint32_t vertexBufferSize = vertices.size() * sizeof(Vertex);
     uint32_t indexBufferSize = indices.size() * sizeof(uint32_t);
-    graphics.createBuffer(vertexBuffer, vertexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-    graphics.createBuffer(indexBuffer, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+    graphics.createBuffer(vertexBuffer, vertexBufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::DeviceStatic);
+    graphics.createBuffer(indexBuffer, indexBufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::DeviceStatic);
 
     graphics.uploadBuffer(vertexBuffer, vertices.data(), vertexBufferSize);
     graphics.uploadBuffer(indexBuffer,  indices.data(), indexBufferSize);
 
+    // start copying scene data while the rest is being set up, first frame submit waits for it
+    graphics.flushUploads();
+
     //
     // Create buffers
     // 
 
-    // ubo
-    graphics.createBuffer(uboBuffer, sizeof(GlobalUBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
-    vkutils::setDebugName(device, (uint64_t)uboBuffer.buffer, VK_OBJECT_TYPE_BUFFER, "globalUBO");
-
-    // materials
     std::vector<Material> &materials = sceneManager->getMaterials();
-    graphics.createBuffer(materialsBuffer, materials.size() * sizeof(Material), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-    vkutils::setDebugName(device, (uint64_t)materialsBuffer.buffer, VK_OBJECT_TYPE_BUFFER, "materialsBuffer");
-
-    // lights
     std::vector<Light> &lights = sceneManager->getLights();
-    if (lights.size() > 0) {
-        graphics.createBuffer(lightsBuffer, lights.size() * sizeof(Light), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-        vkutils::setDebugName(device, (uint64_t)lightsBuffer.buffer, VK_OBJECT_TYPE_BUFFER, "lightsBuffer");
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        std::string suffix = " " + std::to_string(i);
+
+        // ubo
+        graphics.createBuffer(uboBuffers[i], sizeof(GlobalUBO), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, MemoryClass::Dynamic);
+        vkutils::setDebugName(device, (uint64_t)uboBuffers[i].buffer, VK_OBJECT_TYPE_BUFFER, ("globalUBO" + suffix).c_str());
+
+        // materials
+        graphics.createBuffer(materialsBuffers[i], materials.size() * sizeof(Material), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryClass::Dynamic);
+        vkutils::setDebugName(device, (uint64_t)materialsBuffers[i].buffer, VK_OBJECT_TYPE_BUFFER, ("materialsBuffer" + suffix).c_str());
+
+        // lights
+        if (lights.size() > 0) {
+            graphics.createBuffer(lightsBuffers[i], lights.size() * sizeof(Light), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, MemoryClass::Dynamic);
+            vkutils::setDebugName(device, (uint64_t)lightsBuffers[i].buffer, VK_OBJECT_TYPE_BUFFER, ("lightsBuffer" + suffix).c_str());
+        }
     }
 }
 
 void Renderer::updateDynamicBuffers()
 {
+    PROFILE_FUNCTION();
+
+    uint32_t frame = graphics.getCurrentFrame();
+    Buffer &uboBuffer = uboBuffers[frame];
+    Buffer &materialsBuffer = materialsBuffers[frame];
+    Buffer &lightsBuffer = lightsBuffers[frame];
+
     std::vector<Material> &materials = sceneManager->getMaterials();
     std::vector<Light> &lights = sceneManager->getLights();
 
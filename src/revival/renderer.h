@@ -6,7 +6,15 @@
 #include <revival/scene_manager.h>
 #include <revival/game_manager.h>
 #include <revival/globals.h>
+#include <revival/job_system.h>
+#include <revival/vulkan/gpu_profiler.h>
+#include <revival/vulkan/render_graph.h>
+#include <revival/frustum_culler.h>
+#include <revival/instance_batcher.h>
+#include <revival/draw_list.h>
 
+#include <revival/passes/cull_pass.h>
+#include <revival/passes/depth_pyramid_pass.h>
 #include <revival/passes/shadow_pass.h>
 #include <revival/passes/shadow_debug_pass.h>
 #include <revival/passes/scene_pass.h>
@@ -15,23 +23,39 @@
 
 class Physics;
 
+// game objects recorded by one job into one secondary command buffer
+const uint32_t RECORD_GROUP_SIZE = 256;
+
 class Renderer
 {
 public:
-    bool init(GLFWwindow *pWindow, Camera *pCamera, SceneManager *pSceneManager, GameManager *pGameManager, Globals *pGlobals);
+    bool init(GLFWwindow *pWindow, Camera *pCamera, SceneManager *pSceneManager, GameManager *pGameManager, Globals *pGlobals, GraphicsSettings graphicsSettings = {});
     void shutdown();
 
     void render();
 
     VulkanGraphics &getGraphics() { return graphics; };
+    JobSystem &getJobSystem() { return jobSystem; };
+    GpuProfiler &getGpuProfiler() { return gpuProfiler; };
 private:
     void renderScene(VkCommandBuffer cmd, Scene &scene);
     void renderImgui(VkCommandBuffer cmd);
     void updateDynamicBuffers();
     void createResources();
+    // sorts the visible draws of the recorded path, per object mesh or per instanced batch
+    void buildDrawLists();
+
+    // splits [0, count) over the job system, every group is recorded into a secondary buffer from begin
+    // and they are all executed in order into cmd, which has to be inside a pass begun with secondary contents
+    void recordParallel(VkCommandBuffer cmd, uint32_t count, std::function<VkCommandBuffer(uint32_t threadIndex)> begin, std::function<void(VkCommandBuffer secondary, uint32_t index)> record);
 
     GLFWwindow *window;
     VulkanGraphics graphics;
+    JobSystem jobSystem;
+    GpuProfiler gpuProfiler;
+    RenderGraph renderGraph;
+    FrustumCuller frustumCuller;
+    InstanceBatcher instanceBatcher;
     Camera *camera;
     SceneManager *sceneManager;
     GameManager *gameManager;
@@ -40,14 +64,50 @@ private:
     Buffer vertexBuffer;
     Buffer indexBuffer;
 
-    Buffer uboBuffer;
-    Buffer materialsBuffer;
-    Buffer lightsBuffer;
+    // per frame in flight copies, so the cpu never writes into a buffer the gpu is still reading
+    std::array<Buffer, FRAMES_IN_FLIGHT> uboBuffers = {};
+    std::array<Buffer, FRAMES_IN_FLIGHT> materialsBuffers = {};
+    std::array<Buffer, FRAMES_IN_FLIGHT> lightsBuffers = {};
 
     Texture skybox;
 
     bool debugLightDepth = false;
+    // shadow and scene passes record their sorted draws, per object meshes or instanced batches, on the job system.
+    // The GPU driven path has a single indirect draw per pass and always records it directly
+    bool parallelRecording = true;
+    // shadow and scene passes draw what CullPass left visible with one indirect draw each, instead of recording game objects.
+    // On by default where the device has the indirect draw features, see DeviceCapabilities
+    bool gpuDriven = false;
+    bool gpuDrivenSupported = false;
+    // GPU driven scene draws are tested against a depth pyramid of the early draws, the rest are drawn after it
+    bool occlusionCulling = true;
+    // set until the first import of a recreated depth pyramid, which may be a later frame if occlusion culling is off
+    bool depthPyramidRecreated = true;
+    // both paths only draw what FrustumCuller left visible, view 0 is the camera and 1 + i light i.
+    // The GPU driven path writes instances of the union of the camera and light 0 views
+    bool frustumCulling = true;
+    std::vector<uint32_t> gpuCullObjects;
+    // recorded path draws game objects sharing a scene with one instanced draw per mesh, through the instance buffer
+    bool instancing = true;
+    std::vector<InstanceBatch> sceneBatches;
+    std::vector<InstanceBatch> shadowBatches;
+
+    struct ObjectDraw
+    {
+        GameObject *gameObject;
+        const Mesh *mesh;
+    };
+
+    // recorded path draws in sort key order, items index the batches with instancing and the draws without
+    DrawList sceneDrawList;
+    DrawList shadowDrawList;
+    std::vector<ObjectDraw> sceneDraws;
+    std::vector<ObjectDraw> shadowDraws;
+    // recording state and state changes of this frame, one per job system thread
+    std::vector<DrawState> drawStates;
 
+    CullPass cullPass;
+    DepthPyramidPass depthPyramidPass;
     ShadowPass shadowPass;
     ShadowDebugPass shadowDebugPass;
     ScenePass scenePass;
@@ -64,6 +64,13 @@ Scene &SceneManager::loadModel(std::filesystem::path path)
     Scene &scene = scenes.emplace_back();
     processNode(scene, aScene, aScene->mRootNode, dir, materialOffset);
 
+    // sphere around the scene box center that encloses every mesh sphere
+    scene.sphere.center = scene.aabb.isEmpty() ? vec3(0.0f) : scene.aabb.getCenter();
+    for (auto &mesh : scene.meshes) {
+        Sphere sphere = math::transform(mesh.sphere, mesh.matrix);
+        scene.sphere.radius = std::max(scene.sphere.radius, glm::length(sphere.center - scene.sphere.center) + sphere.radius);
+    }
+
     return scene;
 }
 
@@ -81,6 +88,7 @@ void SceneManager::processNode(Scene &scene, const aiScene *aScene, const aiNode
         Mesh mesh = processMesh(aScene, aMesh, directory, materialOffset);
         mesh.matrix = nodeMatrix;
 
+        scene.aabb.extend(math::transform(mesh.aabb, mesh.matrix));
         scene.meshes.push_back(mesh);
     }
 
@@ -119,6 +127,14 @@ Mesh SceneManager::processMesh(const aiScene *aiScene, const aiMesh *aiMesh, std
         }
 
         vertices.push_back(vertex);
+        mesh.aabb.extend(vertex.pos);
+    }
+
+    // centered on the box, tighter than Ritter for the boxy meshes we load
+    if (!mesh.aabb.isEmpty()) {
+        mesh.sphere.center = mesh.aabb.getCenter();
+        for (uint32_t i = vertexOffset; i < vertices.size(); i++)
+            mesh.sphere.radius = std::max(mesh.sphere.radius, glm::length(vertices[i].pos - mesh.sphere.center));
     }
 
     for (unsigned int i = 0; i < aiMesh->mNumFaces; i++) {
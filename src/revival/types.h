@@ -33,6 +33,26 @@ struct Light
     uint shadowMapIndex;
 };
 
+// should match the shader, one per drawn mesh of a game object
+struct alignas(16) InstanceData
+{
+    mat4 model;
+    uint32_t meshIndex;
+    int materialIndex;
+    // stable over frames, indexes the occlusion culling visibility
+    uint32_t visibilityIndex;
+    // instanced draw of the instance, per view
+    uint32_t drawIndex;
+};
+
+// should match the shader, bounding sphere is in mesh space (before Mesh::matrix)
+struct alignas(16) MeshData
+{
+    vec4 sphere;
+    uint32_t firstIndex;
+    uint32_t indexCount;
+};
+
 struct Mesh
 {
     mat4 matrix = mat4(1.0f);
@@ -41,11 +61,29 @@ struct Mesh
     int indexCount;
 
     int materialIndex = -1;
+
+    // mesh space, before matrix
+    AABB aabb;
+    Sphere sphere;
 };
 
 struct Scene
 {
     std::vector<Mesh> meshes;
+
+    // scene space, every mesh with its matrix applied
+    AABB aabb;
+    Sphere sphere;
+};
+
+// instances of one mesh at consecutive indices of the instance buffer, drawn with one instanced draw
+struct InstanceBatch
+{
+    const Mesh *mesh;
+    uint32_t firstInstance;
+    uint32_t instanceCount;
+    // distance from the eye to the nearest instance bounds, for sorting
+    float depth;
 };
 
 struct Billboard
@@ -0,0 +1,51 @@
+#include <revival/vulkan/compute_pipeline_builder.h>
+
+void ComputePipelineBuilder::setPipelineLayout(VkPipelineLayout &layout)
+{
+    pipelineLayout = layout;
+}
+
+void ComputePipelineBuilder::setShader(VkShaderModule module)
+{
+    shaderModule = module;
+}
+
+void ComputePipelineBuilder::setSpecializationConstant(uint32_t constantId, uint32_t offset, size_t size)
+{
+    specializationEntries.push_back({constantId, offset, size});
+}
+
+void ComputePipelineBuilder::setSpecializationData(const void *data, size_t size)
+{
+    specializationData = data;
+    specializationDataSize = size;
+}
+
+void ComputePipelineBuilder::setPipelineCache(VkPipelineCache cache)
+{
+    pipelineCache = cache;
+}
+
+VkPipeline ComputePipelineBuilder::build(VkDevice device)
+{
+    VkSpecializationInfo specializationInfo = {};
+    specializationInfo.mapEntryCount = static_cast<uint32_t>(specializationEntries.size());
+    specializationInfo.pMapEntries = specializationEntries.data();
+    specializationInfo.dataSize = specializationDataSize;
+    specializationInfo.pData = specializationData;
+
+    VkPipelineShaderStageCreateInfo shaderInfo = {VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO};
+    shaderInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    shaderInfo.module = shaderModule;
+    shaderInfo.pName = "main";
+    if (!specializationEntries.empty())
+        shaderInfo.pSpecializationInfo = &specializationInfo;
+
+    VkComputePipelineCreateInfo pipelineInfo = {VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO};
+    pipelineInfo.stage = shaderInfo;
+    pipelineInfo.layout = pipelineLayout;
+
+    VkPipeline pipeline;
+    VK_CHECK(vkCreateComputePipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
+    return pipeline;
+}
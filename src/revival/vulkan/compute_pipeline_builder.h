@@ -0,0 +1,26 @@
+#pragma once
+
+#include <revival/vulkan/utils.h>
+
+// compute counterpart of PipelineBuilder
+class ComputePipelineBuilder
+{
+public:
+    void setPipelineLayout(VkPipelineLayout &layout);
+    void setShader(VkShaderModule module);
+    // constants are copied, data has to stay valid until build
+    void setSpecializationConstant(uint32_t constantId, uint32_t offset, size_t size);
+    void setSpecializationData(const void *data, size_t size);
+
+    void setPipelineCache(VkPipelineCache cache);
+
+    VkPipeline build(VkDevice device);
+
+private:
+    VkShaderModule shaderModule = VK_NULL_HANDLE;
+    std::vector<VkSpecializationMapEntry> specializationEntries;
+    const void *specializationData = nullptr;
+    size_t specializationDataSize = 0;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+};
@@ -0,0 +1,208 @@
+#include <revival/vulkan/gpu_profiler.h>
+#include <revival/vulkan/graphics.h>
+#include <algorithm>
+
+#include "imgui.h"
+
+void GpuProfiler::init(VulkanGraphics &graphics)
+{
+    device = graphics.getDevice();
+    VkPhysicalDevice physicalDevice = graphics.getPhysicalDevice();
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    timestampPeriod = properties.limits.timestampPeriod;
+
+    uint32_t queueFamilyPropsCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropsCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, queueFamilyProps.data());
+
+    uint32_t validBits = queueFamilyProps[graphics.getQueueFamilyIndex()].timestampValidBits;
+    supported = validBits > 0 && timestampPeriod > 0.0f;
+    if (!supported) {
+        printf("Timestamp queries are not supported, gpu profiler disabled.\n");
+        return;
+    }
+    timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+    pools.resize(FRAMES_IN_FLIGHT);
+    frameScopes.resize(FRAMES_IN_FLIGHT);
+    queryCounts.resize(FRAMES_IN_FLIGHT, 0);
+
+    VkQueryPoolCreateInfo poolInfo = {VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO};
+    poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    poolInfo.queryCount = MAX_GPU_SCOPES * 2;
+
+    for (uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        VK_CHECK(vkCreateQueryPool(device, &poolInfo, nullptr, &pools[i]));
+    }
+}
+
+void GpuProfiler::shutdown(VkDevice device)
+{
+    for (auto &pool : pools)
+        vkDestroyQueryPool(device, pool, nullptr);
+
+    pools.clear();
+}
+
+void GpuProfiler::beginFrame(VkCommandBuffer cmd, uint32_t frame)
+{
+    if (!supported) return;
+
+    currentFrame = frame;
+    collect(frame);
+
+    frameScopes[frame].clear();
+    queryCounts[frame] = 0;
+    openScopes.clear();
+
+    vkCmdResetQueryPool(cmd, pools[frame], 0, MAX_GPU_SCOPES * 2);
+}
+
+void GpuProfiler::beginScope(VkCommandBuffer cmd, const char *name)
+{
+    if (!supported) return;
+
+    uint32_t &queryCount = queryCounts[currentFrame];
+    if (queryCount + 2 > MAX_GPU_SCOPES * 2) {
+        // out of queries, scope is ignored but endScope still has to match
+        openScopes.push_back(UINT32_MAX);
+        return;
+    }
+
+    Scope scope = {name, static_cast<uint32_t>(openScopes.size()), queryCount, queryCount + 1};
+    queryCount += 2;
+
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, pools[currentFrame], scope.beginQuery);
+
+    openScopes.push_back(frameScopes[currentFrame].size());
+    frameScopes[currentFrame].push_back(scope);
+}
+
+void GpuProfiler::endScope(VkCommandBuffer cmd)
+{
+    if (!supported) return;
+
+    assert(!openScopes.empty());
+    uint32_t index = openScopes.back();
+    openScopes.pop_back();
+
+    if (index == UINT32_MAX) return;
+
+    Scope &scope = frameScopes[currentFrame][index];
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, pools[currentFrame], scope.endQuery);
+}
+
+void GpuProfiler::collect(uint32_t frame)
+{
+    uint32_t queryCount = queryCounts[frame];
+    if (queryCount == 0) return;
+
+    // results with availability, never waits, missing results are just skipped
+    std::vector<uint64_t> results(queryCount * 2);
+    vkGetQueryPoolResults(device, pools[frame], 0, queryCount, results.size() * sizeof(uint64_t), results.data(), sizeof(uint64_t) * 2, VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WITH_AVAILABILITY_BIT);
+
+    for (auto &scope : frameScopes[frame]) {
+        uint64_t begin = results[scope.beginQuery * 2];
+        uint64_t end = results[scope.endQuery * 2];
+        bool available = results[scope.beginQuery * 2 + 1] && results[scope.endQuery * 2 + 1];
+        if (!available) continue;
+
+        uint64_t ticks = (end - begin) & timestampMask;
+        float ms = float(double(ticks) * timestampPeriod / 1000000.0);
+
+        History &history = getHistory(scope.name, scope.depth);
+        history.samples[history.next] = ms;
+        history.next = (history.next + 1) % GPU_PROFILER_HISTORY;
+        history.count = std::min(history.count + 1, GPU_PROFILER_HISTORY);
+    }
+}
+
+GpuProfiler::History &GpuProfiler::getHistory(const std::string &name, uint32_t depth)
+{
+    for (auto &history : histories) {
+        if (history.name == name)
+            return history;
+    }
+
+    History &history = histories.emplace_back();
+    history.name = name;
+    history.depth = depth;
+    return history;
+}
+
+bool GpuProfiler::getStats(const char *name, Stats &stats)
+{
+    for (auto &history : histories) {
+        if (history.name != name || history.count == 0)
+            continue;
+
+        uint32_t last = (history.next + GPU_PROFILER_HISTORY - 1) % GPU_PROFILER_HISTORY;
+        stats.last = history.samples[last];
+        stats.min = history.samples[0];
+        stats.max = history.samples[0];
+
+        float sum = 0.0f;
+        for (uint32_t i = 0; i < history.count; i++) {
+            sum += history.samples[i];
+            stats.min = std::min(stats.min, history.samples[i]);
+            stats.max = std::max(stats.max, history.samples[i]);
+        }
+        stats.average = sum / history.count;
+
+        return true;
+    }
+
+    return false;
+}
+
+std::vector<std::pair<std::string, GpuProfiler::Stats>> GpuProfiler::getAllStats()
+{
+    std::vector<std::pair<std::string, Stats>> allStats;
+    for (auto &history : histories) {
+        Stats stats;
+        if (getStats(history.name.c_str(), stats))
+            allStats.push_back({history.name, stats});
+    }
+
+    return allStats;
+}
+
+void GpuProfiler::drawImGui()
+{
+    if (!supported) {
+        ImGui::Text("GPU timestamps not supported");
+        return;
+    }
+
+    if (ImGui::BeginTable("GPU timings", 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("Scope");
+        ImGui::TableSetupColumn("Avg ms");
+        ImGui::TableSetupColumn("Min ms");
+        ImGui::TableSetupColumn("Max ms");
+        ImGui::TableHeadersRow();
+
+        for (auto &history : histories) {
+            Stats stats;
+            if (!getStats(history.name.c_str(), stats))
+                continue;
+
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            // nested scopes are indented
+            if (history.depth > 0) ImGui::Indent(history.depth * 8.0f);
+            ImGui::TextUnformatted(history.name.c_str());
+            if (history.depth > 0) ImGui::Unindent(history.depth * 8.0f);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.average);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.min);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", stats.max);
+        }
+
+        ImGui::EndTable();
+    }
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <revival/vulkan/common.h>
+#include <array>
+#include <string>
+#include <vector>
+
+class VulkanGraphics;
+
+const uint32_t MAX_GPU_SCOPES = 64;
+const uint32_t GPU_PROFILER_HISTORY = 128;
+
+// Timestamp queries around named scopes. Every frame in flight has its own query pool, results are read
+// when the slot comes around again (its fence was already waited on), so reading never stalls.
+class GpuProfiler
+{
+public:
+    struct Stats
+    {
+        // milliseconds
+        float last = 0.0f;
+        float average = 0.0f;
+        float min = 0.0f;
+        float max = 0.0f;
+    };
+
+    void init(VulkanGraphics &graphics);
+    void shutdown(VkDevice device);
+
+    // call after the frame fence wait, collects results of the previous use of this frame slot
+    void beginFrame(VkCommandBuffer cmd, uint32_t frame);
+
+    void beginScope(VkCommandBuffer cmd, const char *name);
+    void endScope(VkCommandBuffer cmd);
+
+    // stats over the last GPU_PROFILER_HISTORY frames, false if scope was never measured
+    bool getStats(const char *name, Stats &stats);
+    std::vector<std::pair<std::string, Stats>> getAllStats();
+
+    void drawImGui();
+
+    bool isSupported() { return supported; };
+private:
+    struct Scope
+    {
+        std::string name;
+        uint32_t depth;
+        uint32_t beginQuery;
+        uint32_t endQuery;
+    };
+
+    struct History
+    {
+        std::string name;
+        uint32_t depth = 0;
+        std::array<float, GPU_PROFILER_HISTORY> samples = {};
+        uint32_t count = 0;
+        uint32_t next = 0;
+    };
+
+    void collect(uint32_t frame);
+    History &getHistory(const std::string &name, uint32_t depth);
+
+    VkDevice device;
+    bool supported = false;
+    float timestampPeriod = 1.0f; // nanoseconds per tick
+    uint64_t timestampMask = ~0ull;
+
+    std::vector<VkQueryPool> pools;
+    std::vector<std::vector<Scope>> frameScopes;
+    std::vector<uint32_t> queryCounts;
+
+    uint32_t currentFrame = 0;
+    std::vector<uint32_t> openScopes;
+
+    // in order of first appearance
+    std::vector<History> histories;
+};
@@ -1,10 +1,12 @@
 #include <revival/vulkan/graphics.h>
 #include <revival/vulkan/utils.h>
+#include <revival/profiler.h>
 #include <algorithm>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <vector>
+#include <fstream>
 #include <stb_image.h>
 
 #include <revival/renderer.h>
@@ -29,9 +31,10 @@ VkBool32 VKAPI_PTR debugCallback(VkDebugUtilsMessageSeverityFlagBitsEXT messageS
     return VK_FALSE; // always return false
 }
 
-void VulkanGraphics::init(GLFWwindow *window)
+void VulkanGraphics::init(GLFWwindow *window, GraphicsSettings graphicsSettings)
 {
     pWindow = window;
+    settings = graphicsSettings;
 
     // vulkan initialization
     VK_CHECK(volkInitialize());
@@ -42,33 +45,73 @@ void VulkanGraphics::init(GLFWwindow *window)
     debugMessenger = createDebugMessenger(instance);
 #endif
 
-    surface = createSurface(instance, window);
+    surface = VK_NULL_HANDLE;
+    if (!settings.headless)
+        surface = createSurface(instance, window);
 
     physicalDevice = createPhyiscalDevice(instance, surface, queueFamilyIndex);
-    device = createDevice(instance, surface, physicalDevice, queueFamilyIndex);
+    transferQueueFamilyIndex = findTransferQueueFamily(physicalDevice, queueFamilyIndex, transferQueueIndex);
+    computeQueueFamilyIndex = findComputeQueueFamily(physicalDevice, queueFamilyIndex, transferQueueFamilyIndex, transferQueueIndex, computeQueueIndex);
+    asyncCompute = computeQueueFamilyIndex != queueFamilyIndex || computeQueueIndex != 0;
+    device = createDevice(instance, surface, physicalDevice, queueFamilyIndex, transferQueueFamilyIndex, transferQueueIndex, computeQueueFamilyIndex, computeQueueIndex);
     volkLoadDevice(device);
 
-    allocator = createAllocator(instance, device, physicalDevice, 0);
+    queueFamilies = {queueFamilyIndex};
+    if (transferQueueFamilyIndex != queueFamilyIndex)
+        queueFamilies.push_back(transferQueueFamilyIndex);
+    if (computeQueueFamilyIndex != queueFamilyIndex && computeQueueFamilyIndex != transferQueueFamilyIndex)
+        queueFamilies.push_back(computeQueueFamilyIndex);
+
+    allocator = createAllocator(instance, device, physicalDevice, memoryBudgetSupported ? VMA_ALLOCATOR_CREATE_EXT_MEMORY_BUDGET_BIT : 0);
 
     // graphics/present queue
     vkGetDeviceQueue(device, queueFamilyIndex, 0, &queue);
     assert(queue);
 
-    // create swapchain
-    swapchain = createSwapchain(device, physicalDevice, surface, queueFamilyIndex, window, swapchainExtent);
+    // transfer queue
+    vkGetDeviceQueue(device, transferQueueFamilyIndex, transferQueueIndex, &transferQueue);
+    assert(transferQueue);
 
-    // get swapchain images
-    uint32_t imageCount = 0;
-    vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
-    swapchainImages.resize(imageCount);
-    vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
+    // compute queue
+    vkGetDeviceQueue(device, computeQueueFamilyIndex, computeQueueIndex, &computeQueue);
+    assert(computeQueue);
+    printf("Async compute: %s (family %u, queue %u)\n", asyncCompute ? "yes" : "no", computeQueueFamilyIndex, computeQueueIndex);
 
-    swapchainImageViews = createSwapchainImageViews(device, swapchainImages);
+    uploadQueue.init(*this, transferQueueFamilyIndex, transferQueue);
+    textureRegistry.init(*this);
+
+    pipelineCache = createPipelineCache(device, physicalDevice, PIPELINE_CACHE_PATH);
+
+    if (settings.headless) {
+        // offscreen images stand in for the swapchain
+        presentLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+        createOffscreenImages();
+    } else {
+        // create swapchain
+        swapchain = createSwapchain(device, physicalDevice, surface, queueFamilyIndex, window, swapchainExtent);
+
+        // get swapchain images
+        uint32_t imageCount = 0;
+        vkGetSwapchainImagesKHR(device, swapchain, &imageCount, nullptr);
+        swapchainImages.resize(imageCount);
+        vkGetSwapchainImagesKHR(device, swapchain, &imageCount, swapchainImages.data());
+
+        swapchainImageViews = createSwapchainImageViews(device, swapchainImages);
+    }
 
     // command pool
     commandPool = createCommandPool(device, queueFamilyIndex);
     commandBuffers = createCommandBuffers(device, commandPool);
 
+    for (auto &computePool : computeCommandPools) {
+        VkCommandPoolCreateInfo commandPoolInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+        commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        commandPoolInfo.queueFamilyIndex = computeQueueFamilyIndex;
+        VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &computePool.pool));
+    }
+    computeSemaphore = vkutils::createTimelineSemaphore(device, 0);
+    graphicsSemaphore = vkutils::createTimelineSemaphore(device, 0);
+
     // synchronization primitives
     for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
         acquireSemaphores[i] = vkutils::createSemaphore(device);
@@ -76,22 +119,20 @@ void VulkanGraphics::init(GLFWwindow *window)
         finishRenderFences[i] = vkutils::createFence(device, VK_FENCE_CREATE_SIGNALED_BIT);
     }
 
-    // depth image
-    createImage(depthImage, swapchainExtent.width, swapchainExtent.height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT);
-
-    initImGui();
+    if (!settings.headless)
+        initImGui();
 }
 
 void VulkanGraphics::shutdown()
 {
     vkDeviceWaitIdle(device);
 
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
-    vkDestroyDescriptorPool(device, imGuiDesctiptorPool, nullptr);
-
-    destroyImage(depthImage);
+    if (!settings.headless) {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+        vkDestroyDescriptorPool(device, imGuiDesctiptorPool, nullptr);
+    }
 
     for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
         vkDestroySemaphore(device, acquireSemaphores[i], nullptr);
@@ -101,10 +142,39 @@ void VulkanGraphics::shutdown()
 
     vkDestroyCommandPool(device, commandPool, nullptr);
 
-    for (auto &imageView : swapchainImageViews) {
-        vkDestroyImageView(device, imageView, nullptr);
+    for (auto &computePool : computeCommandPools)
+        vkDestroyCommandPool(device, computePool.pool, nullptr);
+    vkDestroySemaphore(device, computeSemaphore, nullptr);
+    vkDestroySemaphore(device, graphicsSemaphore, nullptr);
+
+    for (auto &pools : threadCommandPools) {
+        for (auto &threadPool : pools)
+            vkDestroyCommandPool(device, threadPool.pool, nullptr);
+        pools.clear();
+    }
+
+    uploadQueue.shutdown();
+    textureRegistry.shutdown();
+
+    for (auto &[desc, sampler] : samplers)
+        vkDestroySampler(device, sampler, nullptr);
+    samplers.clear();
+
+    savePipelineCache(PIPELINE_CACHE_PATH);
+    vkDestroyPipelineCache(device, pipelineCache, nullptr);
+
+    if (settings.headless) {
+        for (auto &image : offscreenImages)
+            destroyImage(image);
+    } else {
+        for (auto &imageView : swapchainImageViews) {
+            vkDestroyImageView(device, imageView, nullptr);
+        }
+        vkDestroySwapchainKHR(device, swapchain, nullptr);
     }
-    vkDestroySwapchainKHR(device, swapchain, nullptr);
+
+    // device is idle, everything destroyed up to here (by the renderer too) only has to run
+    flushDeletionQueue(UINT64_MAX);
 
     vmaDestroyAllocator(allocator);
 
@@ -114,7 +184,8 @@ void VulkanGraphics::shutdown()
     vkDestroyDebugUtilsMessengerEXT(instance, debugMessenger, nullptr);
 #endif
 
-    vkDestroySurfaceKHR(instance, surface, nullptr);
+    if (surface)
+        vkDestroySurfaceKHR(instance, surface, nullptr);
     vkDestroyInstance(instance, nullptr);
 }
 
@@ -138,9 +209,12 @@ VkInstance VulkanGraphics::createInstance()
     std::vector<VkExtensionProperties> supportedExtensions(supportedExtensionCount);
     VK_CHECK(vkEnumerateInstanceExtensionProperties(nullptr, &supportedExtensionCount, supportedExtensions.data()));
 
-    uint32_t count;
-    const char** requiredExtensions = glfwGetRequiredInstanceExtensions(&count);
-    std::vector<const char *> extensions(requiredExtensions, requiredExtensions + count);
+    std::vector<const char *> extensions;
+    if (!settings.headless) {
+        uint32_t count;
+        const char** requiredExtensions = glfwGetRequiredInstanceExtensions(&count);
+        extensions.insert(extensions.end(), requiredExtensions, requiredExtensions + count);
+    }
     if (isDebug)
         extensions.push_back("VK_EXT_debug_utils");
 
@@ -273,34 +347,33 @@ VmaAllocator VulkanGraphics::createAllocator(VkInstance instance, VkDevice devic
 
 VkPhysicalDevice VulkanGraphics::createPhyiscalDevice(VkInstance instance, VkSurfaceKHR surface, uint32_t &queueFamilyIndex)
 {
-    VkPhysicalDevice physicalDevice;
-
     // Physical device
     uint32_t physicalDeviceCount = 0;
     VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, nullptr));
     std::vector<VkPhysicalDevice> physicalDevices(physicalDeviceCount);
     VK_CHECK(vkEnumeratePhysicalDevices(instance, &physicalDeviceCount, physicalDevices.data()));
 
-    bool deviceFound = false;
-    for (uint32_t i = 0; i < physicalDevices.size(); i++) {
-        // properties
-        VkPhysicalDeviceProperties properties;
-        vkGetPhysicalDeviceProperties(physicalDevices[i], &properties);
+    // suitable devices, indexed like physicalDevices
+    std::vector<bool> suitable(physicalDeviceCount, false);
+    std::vector<uint32_t> queueFamilyIndices(physicalDeviceCount, 0);
+    std::vector<DeviceCapabilities> deviceCapabilities(physicalDeviceCount);
 
+    for (uint32_t i = 0; i < physicalDevices.size(); i++) {
         // getting queue families
         uint32_t queueFamilyPropsCount;
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[i], &queueFamilyPropsCount, nullptr);
         std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropsCount);
         vkGetPhysicalDeviceQueueFamilyProperties(physicalDevices[i], &queueFamilyPropsCount, queueFamilyProps.data());
 
-        // check if supports graphics and present queue
+        // check if supports graphics and present queue, without surface any graphics queue will do
         bool haveQueues = false;
         for (uint32_t j = 0; j < queueFamilyPropsCount; j++) {
-            VkBool32 presentSupported;
-            vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], j, surface, &presentSupported);
+            VkBool32 presentSupported = VK_TRUE;
+            if (surface)
+                vkGetPhysicalDeviceSurfaceSupportKHR(physicalDevices[i], j, surface, &presentSupported);
             if (((queueFamilyProps[j].queueFlags & VK_QUEUE_GRAPHICS_BIT) == VK_QUEUE_GRAPHICS_BIT) && (presentSupported == VK_TRUE)) {
                 haveQueues = true;
-                queueFamilyIndex = j;
+                queueFamilyIndices[i] = j;
             }
         }
 
@@ -318,23 +391,211 @@ VkPhysicalDevice VulkanGraphics::createPhyiscalDevice(VkInstance instance, VkSur
 
         // check features vk 1.2
         bool features12Supported = false;
-        if (features12.runtimeDescriptorArray && features12.shaderSampledImageArrayNonUniformIndexing && features12.descriptorBindingStorageBufferUpdateAfterBind) {
+        if (features12.runtimeDescriptorArray && features12.shaderSampledImageArrayNonUniformIndexing && features12.descriptorBindingStorageBufferUpdateAfterBind && features12.timelineSemaphore &&
+            features12.descriptorBindingPartiallyBound && features12.descriptorBindingSampledImageUpdateAfterBind && features12.descriptorBindingUpdateUnusedWhilePending &&
+            features12.descriptorBindingVariableDescriptorCount) {
             features12Supported = true;
         }
 
-        // check device type
-        if (haveQueues && features10Supported && features12Supported) {
-            physicalDevice = physicalDevices[i];
-            deviceFound = true;
+        suitable[i] = haveQueues && features10Supported && features12Supported;
+        deviceCapabilities[i] = queryCapabilities(physicalDevices[i], queueFamilyIndices[i]);
+    }
+
+    // best scored suitable device, unless overridden
+    uint32_t selected = UINT32_MAX;
+    for (uint32_t i = 0; i < physicalDeviceCount; i++) {
+        if (suitable[i] && (selected == UINT32_MAX || deviceCapabilities[i].score > deviceCapabilities[selected].score))
+            selected = i;
+    }
+
+    for (uint32_t i = 0; i < physicalDeviceCount; i++) {
+        bool requested = int32_t(i) == settings.deviceIndex || (settings.deviceName && strstr(deviceCapabilities[i].name, settings.deviceName));
+        if (!requested) continue;
+
+        if (suitable[i]) {
+            selected = i;
             break;
         }
+        printf("Requested device %s lacks required features, ignoring the override.\n", deviceCapabilities[i].name);
     }
-    assert(deviceFound);
 
-    return physicalDevice;
+    if (selected == UINT32_MAX) {
+        printf("No suitable physical device.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    printf("Physical devices:\n");
+    for (uint32_t i = 0; i < physicalDeviceCount; i++) {
+        printf("  %c [%u] %s, score %u%s\n", i == selected ? '*' : ' ', i, deviceCapabilities[i].name,
+               deviceCapabilities[i].score, suitable[i] ? "" : " (missing required features)");
+    }
+
+    queueFamilyIndex = queueFamilyIndices[selected];
+    capabilities = deviceCapabilities[selected];
+    printCapabilities(capabilities);
+
+    return physicalDevices[selected];
 }
 
-VkDevice VulkanGraphics::createDevice(VkInstance instance, VkSurfaceKHR surface, VkPhysicalDevice physical, uint32_t queueFamilyIndex)
+DeviceCapabilities VulkanGraphics::queryCapabilities(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex)
+{
+    DeviceCapabilities caps;
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+    strncpy(caps.name, properties.deviceName, VK_MAX_PHYSICAL_DEVICE_NAME_SIZE - 1);
+    caps.type = properties.deviceType;
+    caps.apiVersion = properties.apiVersion;
+
+    VkPhysicalDeviceMemoryProperties memoryProperties;
+    vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++) {
+        if (memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+            caps.vram += memoryProperties.memoryHeaps[i].size;
+    }
+
+    // extensions
+    uint32_t extensionCount = 0;
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, nullptr));
+    std::vector<VkExtensionProperties> extensions(extensionCount);
+    VK_CHECK(vkEnumerateDeviceExtensionProperties(physicalDevice, nullptr, &extensionCount, extensions.data()));
+
+    bool extendedDynamicStateExtension = false;
+    for (auto &extension : extensions) {
+        if (strcmp(extension.extensionName, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME) == 0)
+            caps.memoryBudget = true;
+        if (strcmp(extension.extensionName, VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME) == 0)
+            extendedDynamicStateExtension = true;
+    }
+
+    // features
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT};
+    VkPhysicalDeviceVulkan12Features features12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    VkPhysicalDeviceVulkan11Features features11 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+    VkPhysicalDeviceFeatures2 features = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2};
+    features.pNext = &features12;
+    features12.pNext = &features11;
+    if (extendedDynamicStateExtension)
+        features11.pNext = &extendedDynamicStateFeatures;
+    vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+    caps.multiview = features11.multiview;
+    caps.samplerAnisotropy = features.features.samplerAnisotropy;
+    caps.multiDrawIndirect = features.features.multiDrawIndirect;
+    caps.drawIndirectFirstInstance = features.features.drawIndirectFirstInstance;
+    caps.drawIndirectCount = features12.drawIndirectCount;
+
+    // core in vk 1.3
+    if (caps.apiVersion >= VK_API_VERSION_1_3) {
+        caps.extendedDynamicState = true;
+    } else if (extendedDynamicStateFeatures.extendedDynamicState) {
+        caps.extendedDynamicState = true;
+        caps.extendedDynamicStateExtension = true;
+    }
+
+    // timestamps are written from the graphics queue
+    uint32_t queueFamilyPropsCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropsCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, queueFamilyProps.data());
+    caps.timestampQueries = queueFamilyProps[queueFamilyIndex].timestampValidBits > 0 && properties.limits.timestampPeriod > 0.0f;
+
+    // device type dominates, then memory (1 point per 256 MiB), then optional features
+    switch (caps.type) {
+        case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:   caps.score = 10000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU: caps.score = 1000; break;
+        case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:    caps.score = 100; break;
+        case VK_PHYSICAL_DEVICE_TYPE_CPU:            caps.score = 10; break;
+        default: break;
+    }
+    caps.score += uint32_t(caps.vram / (256ull * 1024 * 1024));
+    caps.score += 50 * (caps.memoryBudget + caps.timestampQueries + caps.multiview + caps.extendedDynamicState);
+    caps.score += 50 * (caps.multiDrawIndirect && caps.drawIndirectFirstInstance && caps.drawIndirectCount);
+
+    return caps;
+}
+
+void VulkanGraphics::printCapabilities(const DeviceCapabilities &caps)
+{
+    const char *typeNames[] = {"other", "integrated", "discrete", "virtual", "cpu"};
+    const char *typeName = caps.type <= VK_PHYSICAL_DEVICE_TYPE_CPU ? typeNames[caps.type] : "unknown";
+
+    printf("Device: %s (%s), Vulkan %u.%u.%u\n", caps.name, typeName,
+           VK_API_VERSION_MAJOR(caps.apiVersion), VK_API_VERSION_MINOR(caps.apiVersion), VK_API_VERSION_PATCH(caps.apiVersion));
+    printf("  VRAM: %llu MiB\n", (unsigned long long)(caps.vram / (1024 * 1024)));
+    printf("  memory budget: %s\n", caps.memoryBudget ? "yes" : "no");
+    printf("  timestamp queries: %s\n", caps.timestampQueries ? "yes" : "no");
+    printf("  multiview: %s\n", caps.multiview ? "yes" : "no");
+    printf("  extended dynamic state: %s\n", caps.extendedDynamicState ? (caps.extendedDynamicStateExtension ? "yes (extension)" : "yes") : "no");
+    printf("  sampler anisotropy: %s\n", caps.samplerAnisotropy ? "yes" : "no");
+    printf("  indirect draws: multi %s, first instance %s, count %s\n", caps.multiDrawIndirect ? "yes" : "no", caps.drawIndirectFirstInstance ? "yes" : "no", caps.drawIndirectCount ? "yes" : "no");
+}
+
+uint32_t VulkanGraphics::findTransferQueueFamily(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex, uint32_t &queueIndex)
+{
+    uint32_t queueFamilyPropsCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropsCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, queueFamilyProps.data());
+
+    queueIndex = 0;
+
+    // dedicated transfer family (usually dma engine)
+    for (uint32_t i = 0; i < queueFamilyPropsCount; i++) {
+        VkQueueFlags flags = queueFamilyProps[i].queueFlags;
+        if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & VK_QUEUE_GRAPHICS_BIT) && !(flags & VK_QUEUE_COMPUTE_BIT))
+            return i;
+    }
+
+    // any family without graphics
+    for (uint32_t i = 0; i < queueFamilyPropsCount; i++) {
+        VkQueueFlags flags = queueFamilyProps[i].queueFlags;
+        if ((flags & (VK_QUEUE_TRANSFER_BIT | VK_QUEUE_COMPUTE_BIT)) && !(flags & VK_QUEUE_GRAPHICS_BIT))
+            return i;
+    }
+
+    // second queue of the graphics family.
+    // NOTE: if there is only one queue, uploads and frames share it and should be submitted from the same thread.
+    if (queueFamilyProps[graphicsQueueFamilyIndex].queueCount > 1)
+        queueIndex = 1;
+
+    return graphicsQueueFamilyIndex;
+}
+
+uint32_t VulkanGraphics::findComputeQueueFamily(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex, uint32_t transferQueueFamilyIndex, uint32_t transferQueueIndex, uint32_t &queueIndex)
+{
+    uint32_t queueFamilyPropsCount;
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, nullptr);
+    std::vector<VkQueueFamilyProperties> queueFamilyProps(queueFamilyPropsCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropsCount, queueFamilyProps.data());
+
+    queueIndex = 0;
+
+    // compute family without graphics (async compute engine), uploads may already use its first queue
+    for (uint32_t i = 0; i < queueFamilyPropsCount; i++) {
+        VkQueueFlags flags = queueFamilyProps[i].queueFlags;
+        if (!(flags & VK_QUEUE_COMPUTE_BIT) || (flags & VK_QUEUE_GRAPHICS_BIT))
+            continue;
+
+        if (i != transferQueueFamilyIndex)
+            return i;
+
+        if (queueFamilyProps[i].queueCount > transferQueueIndex + 1) {
+            queueIndex = transferQueueIndex + 1;
+            return i;
+        }
+    }
+
+    // another queue of the graphics family, still runs concurrently with the frame
+    uint32_t usedQueues = transferQueueFamilyIndex == graphicsQueueFamilyIndex ? transferQueueIndex + 1 : 1;
+    if (queueFamilyProps[graphicsQueueFamilyIndex].queueCount > usedQueues)
+        queueIndex = usedQueues;
+
+    // NOTE: queueIndex 0 of the graphics family is the graphics queue, compute is then submitted in order with frames
+    return graphicsQueueFamilyIndex;
+}
+
+VkDevice VulkanGraphics::createDevice(VkInstance instance, VkSurfaceKHR surface, VkPhysicalDevice physical, uint32_t queueFamilyIndex, uint32_t transferQueueFamilyIndex, uint32_t transferQueueIndex, uint32_t computeQueueFamilyIndex, uint32_t computeQueueIndex)
 {
     // get device extensions
     uint32_t supportedDeviceExtensionCount = 0;
@@ -342,7 +603,9 @@ VkDevice VulkanGraphics::createDevice(VkInstance instance, VkSurfaceKHR surface,
     std::vector<VkExtensionProperties> supportedDeviceExtensions(supportedDeviceExtensionCount);
     VK_CHECK(vkEnumerateDeviceExtensionProperties(physical, nullptr, &supportedDeviceExtensionCount, supportedDeviceExtensions.data()));
 
-    std::vector<const char*> deviceExtensions = {"VK_KHR_swapchain"};
+    std::vector<const char*> deviceExtensions = {};
+    if (!settings.headless)
+        deviceExtensions.push_back("VK_KHR_swapchain");
 
     // check support
     for (auto requiredExtension : deviceExtensions) {
@@ -360,34 +623,87 @@ VkDevice VulkanGraphics::createDevice(VkInstance instance, VkSurfaceKHR surface,
         }
     }
 
+    // optional extensions
+    if (capabilities.memoryBudget) {
+        deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+        memoryBudgetSupported = true;
+    }
+    if (capabilities.extendedDynamicStateExtension)
+        deviceExtensions.push_back(VK_EXT_EXTENDED_DYNAMIC_STATE_EXTENSION_NAME);
+
     // vk 1.0 features
     VkPhysicalDeviceFeatures features10 = {};
     features10.fillModeNonSolid = VK_TRUE;
     features10.shaderSampledImageArrayDynamicIndexing = VK_TRUE;
+    // GPU driven draws are optional, the instance index is passed as firstInstance
+    features10.multiDrawIndirect = capabilities.multiDrawIndirect;
+    features10.drawIndirectFirstInstance = capabilities.drawIndirectFirstInstance;
+
+    // anisotropic filtering is optional, samplers fall back to plain filtering without it
+    if (capabilities.samplerAnisotropy) {
+        features10.samplerAnisotropy = VK_TRUE;
+
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physical, &properties);
+        maxSamplerAnisotropy = properties.limits.maxSamplerAnisotropy;
+    }
+
+    // vk 1.1 features, all optional
+    VkPhysicalDeviceVulkan11Features features11 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_1_FEATURES};
+    features11.multiview = capabilities.multiview;
 
     // vk 1.2 features
     VkPhysicalDeviceVulkan12Features features12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES};
+    features12.pNext = &features11;
     features12.runtimeDescriptorArray = VK_TRUE;
     features12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
     features12.descriptorBindingStorageBufferUpdateAfterBind = VK_TRUE;
+    features12.timelineSemaphore = VK_TRUE;
+    // bindless texture table
+    features12.descriptorBindingPartiallyBound = VK_TRUE;
+    features12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    features12.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+    features12.descriptorBindingVariableDescriptorCount = VK_TRUE;
+    features12.drawIndirectCount = capabilities.drawIndirectCount;
 
     // dynamic rendering features
     VkPhysicalDeviceDynamicRenderingFeatures dynamicRenderingFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_DYNAMIC_RENDERING_FEATURES};
     dynamicRenderingFeatures.dynamicRendering = VK_TRUE;
     dynamicRenderingFeatures.pNext = &features12;
 
-    // Queue family info
-    const float queuePriority = 1.0f;
-    VkDeviceQueueCreateInfo queueInfo = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
-    queueInfo.queueFamilyIndex = queueFamilyIndex;
-    queueInfo.queueCount = 1;
-    queueInfo.pQueuePriorities = &queuePriority;
+    VkPhysicalDeviceExtendedDynamicStateFeaturesEXT extendedDynamicStateFeatures = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_EXTENDED_DYNAMIC_STATE_FEATURES_EXT};
+    if (capabilities.extendedDynamicStateExtension) {
+        extendedDynamicStateFeatures.extendedDynamicState = VK_TRUE;
+        features11.pNext = &extendedDynamicStateFeatures;
+    }
+
+    // Queue family info, every family gets queues up to the highest index used from it (graphics, transfer, compute)
+    const float queuePriorities[] = {1.0f, 1.0f, 1.0f};
+    std::vector<VkDeviceQueueCreateInfo> queueInfos;
+
+    auto addQueue = [&](uint32_t family, uint32_t index) {
+        for (auto &queueInfo : queueInfos) {
+            if (queueInfo.queueFamilyIndex == family) {
+                queueInfo.queueCount = std::max(queueInfo.queueCount, index + 1);
+                return;
+            }
+        }
+
+        VkDeviceQueueCreateInfo queueInfo = {VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO};
+        queueInfo.queueFamilyIndex = family;
+        queueInfo.queueCount = index + 1;
+        queueInfo.pQueuePriorities = queuePriorities;
+        queueInfos.push_back(queueInfo);
+    };
+    addQueue(queueFamilyIndex, 0);
+    addQueue(transferQueueFamilyIndex, transferQueueIndex);
+    addQueue(computeQueueFamilyIndex, computeQueueIndex);
 
     // Logical device
     VkDeviceCreateInfo deviceInfo = {VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO};
     deviceInfo.pNext = &dynamicRenderingFeatures;
-    deviceInfo.queueCreateInfoCount = 1;
-    deviceInfo.pQueueCreateInfos = &queueInfo;
+    deviceInfo.queueCreateInfoCount = static_cast<uint32_t>(queueInfos.size());
+    deviceInfo.pQueueCreateInfos = queueInfos.data();
     deviceInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size());
     deviceInfo.ppEnabledExtensionNames = deviceExtensions.data();
     deviceInfo.pEnabledFeatures = &features10;
@@ -398,7 +714,7 @@ VkDevice VulkanGraphics::createDevice(VkInstance instance, VkSurfaceKHR surface,
     return device;
 }
 
-VkSwapchainKHR VulkanGraphics::createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t queueFamilyIndex, GLFWwindow *window, VkExtent2D &swapchainExtent)
+VkSwapchainKHR VulkanGraphics::createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t queueFamilyIndex, GLFWwindow *window, VkExtent2D &swapchainExtent, VkSwapchainKHR oldSwapchain)
 {
     // Get surface capabilities
     VkSurfaceCapabilitiesKHR capabilities;
@@ -409,11 +725,37 @@ VkSwapchainKHR VulkanGraphics::createSwapchain(VkDevice device, VkPhysicalDevice
     swapchainExtent.width = std::clamp(uint32_t(width), capabilities.minImageExtent.width, capabilities.maxImageExtent.width);
     swapchainExtent.height = std::clamp(uint32_t(height), capabilities.minImageExtent.height, capabilities.maxImageExtent.height);
 
+    // present mode, FIFO is the only one that is guaranteed
+    uint32_t presentModeCount = 0;
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, nullptr);
+    supportedPresentModes.resize(presentModeCount);
+    vkGetPhysicalDeviceSurfacePresentModesKHR(physicalDevice, surface, &presentModeCount, supportedPresentModes.data());
+
+    auto isSupported = [&](VkPresentModeKHR mode) {
+        return std::find(supportedPresentModes.begin(), supportedPresentModes.end(), mode) != supportedPresentModes.end();
+    };
+
+    presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    if (isSupported(settings.presentMode)) {
+        presentMode = settings.presentMode;
+    } else if (settings.presentMode == VK_PRESENT_MODE_IMMEDIATE_KHR && isSupported(VK_PRESENT_MODE_MAILBOX_KHR)) {
+        // still uncapped, just without tearing
+        presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+    } else {
+        printf("Present mode %d is not supported, using FIFO.\n", settings.presentMode);
+    }
+
+    // image count, one more than minimum so we don't wait on the driver before acquiring
+    uint32_t imageCount = settings.imageCount > 0 ? settings.imageCount : capabilities.minImageCount + 1;
+    imageCount = std::max(imageCount, capabilities.minImageCount);
+    if (capabilities.maxImageCount > 0)
+        imageCount = std::min(imageCount, capabilities.maxImageCount);
+
     VkSwapchainCreateInfoKHR swapchainCI{};
     swapchainCI.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;
     swapchainCI.surface = surface;
-    swapchainCI.minImageCount = capabilities.minImageCount;
-    swapchainCI.imageFormat = VK_FORMAT_B8G8R8A8_SRGB;  // TODO: change hardcoded format
+    swapchainCI.minImageCount = imageCount;
+    swapchainCI.imageFormat = swapchainFormat;
     swapchainCI.imageColorSpace = VK_COLOR_SPACE_SRGB_NONLINEAR_KHR;
     swapchainCI.imageExtent = swapchainExtent;
     swapchainCI.imageArrayLayers = 1;
@@ -423,7 +765,9 @@ VkSwapchainKHR VulkanGraphics::createSwapchain(VkDevice device, VkPhysicalDevice
     swapchainCI.pQueueFamilyIndices = &queueFamilyIndex;
     swapchainCI.preTransform = capabilities.currentTransform;
     swapchainCI.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
-    swapchainCI.presentMode = VK_PRESENT_MODE_FIFO_KHR; // NOTE: this only works with vsync
+    swapchainCI.presentMode = presentMode;
+    // lets the driver reuse resources of the old swapchain, its images still in flight stay valid until it is destroyed
+    swapchainCI.oldSwapchain = oldSwapchain;
 
     VkSwapchainKHR swapchain;
     VK_CHECK(vkCreateSwapchainKHR(device, &swapchainCI, nullptr, &swapchain));
@@ -438,7 +782,7 @@ std::vector<VkImageView> VulkanGraphics::createSwapchainImageViews(VkDevice devi
         VkImageViewCreateInfo viewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
         viewInfo.image = swapchainImages[i];
         viewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
-        viewInfo.format = VK_FORMAT_B8G8R8A8_SRGB;
+        viewInfo.format = swapchainFormat;
         viewInfo.components.r = VK_COMPONENT_SWIZZLE_IDENTITY;
         viewInfo.components.g = VK_COMPONENT_SWIZZLE_IDENTITY;
         viewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
@@ -451,6 +795,85 @@ std::vector<VkImageView> VulkanGraphics::createSwapchainImageViews(VkDevice devi
     return swapchainImageViews;
 }
 
+void VulkanGraphics::createOffscreenImages()
+{
+    swapchainExtent = {settings.width, settings.height};
+
+    // one image per frame in flight, so a frame never renders into an image that is still read back
+    offscreenImages.resize(FRAMES_IN_FLIGHT);
+    for (uint32_t i = 0; i < offscreenImages.size(); i++) {
+        createImage(offscreenImages[i], swapchainExtent.width, swapchainExtent.height, swapchainFormat, VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
+        vkutils::setDebugName(device, (uint64_t)offscreenImages[i].handle, VK_OBJECT_TYPE_IMAGE, ("offscreen " + std::to_string(i)).c_str());
+
+        swapchainImages.push_back(offscreenImages[i].handle);
+        swapchainImageViews.push_back(offscreenImages[i].view);
+    }
+}
+
+VkPipelineCache VulkanGraphics::createPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const char *path)
+{
+    std::vector<char> data;
+    std::ifstream file(path, std::ios::ate | std::ios::binary);
+
+    if (file.is_open()) {
+        size_t size = file.tellg();
+        data.resize(size);
+        file.seekg(0);
+        file.read(data.data(), size);
+        file.close();
+    }
+
+    // driver rejects or silently ignores foreign data, validate the header so a stale cache is dropped explicitly
+    if (data.size() > 0) {
+        VkPhysicalDeviceProperties properties;
+        vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+        VkPipelineCacheHeaderVersionOne header = {};
+        bool valid = data.size() >= sizeof(header);
+        if (valid) {
+            memcpy(&header, data.data(), sizeof(header));
+            valid = header.headerSize >= sizeof(header) &&
+                header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+                header.vendorID == properties.vendorID &&
+                header.deviceID == properties.deviceID &&
+                memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+        }
+
+        if (!valid) {
+            printf("Pipeline cache %s doesn't match the device, ignoring it\n", path);
+            data.clear();
+        }
+    }
+
+    pipelineCacheWarm = data.size() > 0;
+
+    VkPipelineCacheCreateInfo cacheInfo = {VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO};
+    cacheInfo.initialDataSize = data.size();
+    cacheInfo.pInitialData = data.data();
+
+    VkPipelineCache cache;
+    VK_CHECK(vkCreatePipelineCache(device, &cacheInfo, nullptr, &cache));
+    return cache;
+}
+
+void VulkanGraphics::savePipelineCache(const char *path)
+{
+    size_t size = 0;
+    VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr));
+
+    std::vector<char> data(size);
+    VK_CHECK(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()));
+
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file.is_open()) {
+        printf("Failed to write pipeline cache - %s\n", path);
+        return;
+    }
+
+    file.write(data.data(), size);
+    file.close();
+}
+
 VkCommandPool VulkanGraphics::createCommandPool(VkDevice device, uint32_t queueFamilyIndex)
 {
     VkCommandPool commandPool;
@@ -486,25 +909,11 @@ void VulkanGraphics::recreateSwapchain()
         glfwWaitEvents();
     }
 
-    vkDeviceWaitIdle(device);
-
-    for (auto &imageView : swapchainImageViews) {
-        vkDestroyImageView(device, imageView, nullptr);
-    }
-    vkDestroySwapchainKHR(device, swapchain, nullptr);
+    // NOTE: no wait for the device, frames in flight keep rendering into and presenting the old images
+    VkSwapchainKHR oldSwapchain = swapchain;
+    std::vector<VkImageView> oldImageViews = std::move(swapchainImageViews);
 
-    destroyImage(depthImage);
-
-    for (unsigned int i = 0; i < FRAMES_IN_FLIGHT; i++) {
-        vkDestroySemaphore(device, acquireSemaphores[i], nullptr);
-        vkDestroySemaphore(device, submitSemaphores[i], nullptr);
-        vkDestroyFence(device, finishRenderFences[i], nullptr);
-        acquireSemaphores[i] = vkutils::createSemaphore(device);
-        submitSemaphores[i] = vkutils::createSemaphore(device);
-        finishRenderFences[i] = vkutils::createFence(device, VK_FENCE_CREATE_SIGNALED_BIT);
-    }
-
-    swapchain = createSwapchain(device, physicalDevice, surface, queueFamilyIndex, pWindow, swapchainExtent);
+    swapchain = createSwapchain(device, physicalDevice, surface, queueFamilyIndex, pWindow, swapchainExtent, oldSwapchain);
 
     // get swapchain images
     uint32_t imageCount = 0;
@@ -514,21 +923,58 @@ void VulkanGraphics::recreateSwapchain()
 
     swapchainImageViews = createSwapchainImageViews(device, swapchainImages);
 
-    createImage(depthImage, swapchainExtent.width, swapchainExtent.height, VK_FORMAT_D32_SFLOAT, VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_DEPTH_BIT);
+    destroyDeferred([this, oldSwapchain, oldImageViews]() {
+        for (auto &imageView : oldImageViews)
+            vkDestroyImageView(device, imageView, nullptr);
+        vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+    });
 };
 
 VkCommandBuffer VulkanGraphics::beginCommandBuffer()
 {
-    VK_CHECK(vkWaitForFences(device, 1, &finishRenderFences[currentFrame], VK_TRUE, ~0ull));
+    {
+        PROFILE_SCOPE("Wait for frame fence");
+        VK_CHECK(vkWaitForFences(device, 1, &finishRenderFences[currentFrame], VK_TRUE, ~0ull));
+    }
+
+    // the fence of this slot was signaled by frame frameNumber - FRAMES_IN_FLIGHT, every frame up to it has finished
+    frameNumber++;
+    if (frameNumber >= FRAMES_IN_FLIGHT)
+        flushDeletionQueue(frameNumber - FRAMES_IN_FLIGHT);
+    checkMemoryBudget();
+
+    if (settings.headless) {
+        imageIndex = currentFrame;
+    } else {
+        // the acquire semaphore is signaled only on success, so it can be reused for the retry.
+        // Suboptimal images are still presentable, the swapchain is recreated after present.
+        VkResult result = vkAcquireNextImageKHR(device, swapchain, ~0ull, acquireSemaphores[currentFrame], nullptr, &imageIndex);
+        while (result == VK_ERROR_OUT_OF_DATE_KHR) {
+            recreateSwapchain();
+            result = vkAcquireNextImageKHR(device, swapchain, ~0ull, acquireSemaphores[currentFrame], nullptr, &imageIndex);
+        }
+
+        if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
+            printf("Failed to acquire swapchain image.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    // reset only once this frame is sure to be submitted
     VK_CHECK(vkResetFences(device, 1, &finishRenderFences[currentFrame]));
 
-    VkResult result = vkAcquireNextImageKHR(device, swapchain, ~0ull, acquireSemaphores[currentFrame], nullptr, &imageIndex);
-    if (resizeRequested || result == VK_ERROR_OUT_OF_DATE_KHR) {
-        recreateSwapchain();
-        beginCommandBuffer(); // is this right?
-    } else if (result != VK_SUCCESS && result != VK_SUBOPTIMAL_KHR) {
-        printf("Failed to acquire swapchain image.\n");
-        exit(EXIT_FAILURE);
+    // secondary buffers of this frame slot are not in use anymore
+    for (auto &threadPool : threadCommandPools[currentFrame]) {
+        if (threadPool.used == 0) continue;
+        VK_CHECK(vkResetCommandPool(device, threadPool.pool, 0));
+        threadPool.used = 0;
+    }
+
+    // neither is its compute work, the frame waited for it
+    ComputeCommandPool &computePool = computeCommandPools[currentFrame];
+    if (computePool.used > 0) {
+        VK_CHECK(vkResetCommandPool(device, computePool.pool, 0));
+        computePool.used = 0;
     }
 
     VkCommandBuffer cmd = commandBuffers[currentFrame];
@@ -550,165 +996,321 @@ void VulkanGraphics::endCommandBuffer(VkCommandBuffer cmd)
 
 void VulkanGraphics::submitCommandBuffer(VkCommandBuffer cmd)
 {
+    PROFILE_FUNCTION();
+
+    // Uploads recorded so far are consumed by this frame, gpu waits for them instead of the cpu
+    uploadQueue.flush();
+
+    std::vector<VkSemaphore> waitSemaphores;
+    std::vector<uint64_t> waitValues;
+    std::vector<VkPipelineStageFlags> waitStages;
+
+    // headless frames have no image to acquire
+    if (!settings.headless) {
+        waitSemaphores.push_back(acquireSemaphores[currentFrame]);
+        waitValues.push_back(0);
+        waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+
+    waitSemaphores.push_back(uploadQueue.getSemaphore());
+    waitValues.push_back(uploadQueue.getSubmittedValue());
+    waitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT);
+
+    // compute work of this frame, only the stages that consume it wait
+    if (computeWaitStages) {
+        waitSemaphores.push_back(computeSemaphore);
+        waitValues.push_back(computeValue);
+        waitStages.push_back(computeWaitStages);
+        computeWaitStages = 0;
+    }
+
+    // binary semaphores ignore their value
+    std::vector<VkSemaphore> signalSemaphores = {graphicsSemaphore};
+    std::vector<uint64_t> signalValues = {++graphicsValue};
+    if (!settings.headless) {
+        signalSemaphores.push_back(submitSemaphores[currentFrame]);
+        signalValues.push_back(0);
+    }
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timelineInfo.waitSemaphoreValueCount = static_cast<uint32_t>(waitValues.size());
+    timelineInfo.pWaitSemaphoreValues = waitValues.data();
+    timelineInfo.signalSemaphoreValueCount = static_cast<uint32_t>(signalValues.size());
+    timelineInfo.pSignalSemaphoreValues = signalValues.data();
+
     // Submit
     VkSubmitInfo submit = {};
-    VkPipelineStageFlags stages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
     submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.waitSemaphoreCount = 1;
-    submit.pWaitSemaphores = &acquireSemaphores[currentFrame];
-    submit.pWaitDstStageMask = stages;
+    submit.pNext = &timelineInfo;
+    submit.waitSemaphoreCount = static_cast<uint32_t>(waitSemaphores.size());
+    submit.pWaitSemaphores = waitSemaphores.data();
+    submit.pWaitDstStageMask = waitStages.data();
     submit.commandBufferCount = 1;
     submit.pCommandBuffers = &cmd;
-    submit.signalSemaphoreCount = 1;
-    submit.pSignalSemaphores = &submitSemaphores[currentFrame];
+    submit.signalSemaphoreCount = static_cast<uint32_t>(signalSemaphores.size());
+    submit.pSignalSemaphores = signalSemaphores.data();
     VK_CHECK(vkQueueSubmit(queue, 1, &submit, finishRenderFences[currentFrame]));
 
     // Present
-    VkPresentInfoKHR presentInfo = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
-    presentInfo.swapchainCount = 1;
-    presentInfo.pSwapchains = &swapchain;
-    presentInfo.pImageIndices = &imageIndex;
-    presentInfo.waitSemaphoreCount = 1;
-    presentInfo.pWaitSemaphores = &submitSemaphores[currentFrame];
-
-    VkResult result = vkQueuePresentKHR(queue, &presentInfo);
-    if (resizeRequested || result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
-        recreateSwapchain();
+    if (!settings.headless) {
+        VkPresentInfoKHR presentInfo = {VK_STRUCTURE_TYPE_PRESENT_INFO_KHR};
+        presentInfo.swapchainCount = 1;
+        presentInfo.pSwapchains = &swapchain;
+        presentInfo.pImageIndices = &imageIndex;
+        presentInfo.waitSemaphoreCount = 1;
+        presentInfo.pWaitSemaphores = &submitSemaphores[currentFrame];
+
+        VkResult result = vkQueuePresentKHR(queue, &presentInfo);
+        if (resizeRequested || result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR) {
+            recreateSwapchain();
+        }
     }
 
     currentFrame = (currentFrame + 1) % FRAMES_IN_FLIGHT;
 }
 
-void VulkanGraphics::beginFrame(VkCommandBuffer cmd)
+VkCommandBuffer VulkanGraphics::beginComputeCommandBuffer()
+{
+    ComputeCommandPool &computePool = computeCommandPools[currentFrame];
+
+    if (computePool.used == computePool.buffers.size()) {
+        VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        bufferAllocInfo.commandPool = computePool.pool;
+        bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        bufferAllocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer buffer;
+        VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &buffer));
+        computePool.buffers.push_back(buffer);
+    }
+
+    VkCommandBuffer cmd = computePool.buffers[computePool.used++];
+
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+    return cmd;
+}
+
+void VulkanGraphics::submitComputeCommandBuffer(VkCommandBuffer cmd, VkPipelineStageFlags graphicsWaitStages, VkPipelineStageFlags previousFrameWaitStages)
 {
-    vkutils::insertImageBarrier(cmd, swapchainImages[imageIndex], 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-
-    VkRenderingAttachmentInfo colorAttachmentInfo = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    colorAttachmentInfo.clearValue = {{{0.0, 0.0, 0.0, 1.0}}};
-    colorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachmentInfo.imageView = swapchainImageViews[imageIndex];
-    colorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-    colorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    VkRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_RENDERING_INFO};
-    renderingInfo.colorAttachmentCount = 1;
-    renderingInfo.pColorAttachments = &colorAttachmentInfo;
-    renderingInfo.renderArea.extent = swapchainExtent;
-    renderingInfo.renderArea.offset = {0};
-    renderingInfo.layerCount = 1;
-
-    // Rendering begin
-    vkCmdBeginRendering(cmd, &renderingInfo);
-
-    // Setup dynamic state
-    vkutils::setViewport(cmd, 0.0f, 0.0f, swapchainExtent.width, swapchainExtent.height);
-    vkutils::setScissor(cmd, swapchainExtent);
+    PROFILE_FUNCTION();
+    // the frame has to wait for it, its fence is what makes the command pool reset safe
+    assert(graphicsWaitStages != 0);
+
+    VK_CHECK(vkEndCommandBuffer(cmd));
+
+    // compute may consume uploads too
+    uploadQueue.flush();
+
+    VkSemaphore waitSemaphores[] = {uploadQueue.getSemaphore(), graphicsSemaphore};
+    uint64_t waitValues[] = {uploadQueue.getSubmittedValue(), graphicsValue};
+    VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, previousFrameWaitStages};
+    // nothing to wait for before the first frame
+    uint32_t waitCount = previousFrameWaitStages && graphicsValue > 0 ? 2 : 1;
+    uint64_t signalValue = ++computeValue;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timelineInfo.waitSemaphoreValueCount = waitCount;
+    timelineInfo.pWaitSemaphoreValues = waitValues;
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submit = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit.pNext = &timelineInfo;
+    submit.waitSemaphoreCount = waitCount;
+    submit.pWaitSemaphores = waitSemaphores;
+    submit.pWaitDstStageMask = waitStages;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &cmd;
+    submit.signalSemaphoreCount = 1;
+    submit.pSignalSemaphores = &computeSemaphore;
+    VK_CHECK(vkQueueSubmit(computeQueue, 1, &submit, VK_NULL_HANDLE));
+
+    computeWaitStages |= graphicsWaitStages;
 }
 
-void VulkanGraphics::beginFrame(VkCommandBuffer cmd, Image &depthImage)
+void VulkanGraphics::destroyDeferred(std::function<void()> destroy)
 {
-    vkutils::insertImageBarrier(cmd, swapchainImages[imageIndex], 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-    vkutils::insertImageBarrier(cmd, depthImage.handle, 0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1});
-
-    VkRenderingAttachmentInfo colorAttachmentInfo = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    colorAttachmentInfo.clearValue = {{{0.0, 0.0, 0.0, 1.0}}};
-    colorAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
-    colorAttachmentInfo.imageView = swapchainImageViews[imageIndex];
-    colorAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    colorAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    VkRenderingAttachmentInfo depthAttachmentInfo = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
-    depthAttachmentInfo.clearValue.depthStencil = {0.0, 0};
-    depthAttachmentInfo.imageLayout = VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL;
-    depthAttachmentInfo.imageView = depthImage.view;
-    depthAttachmentInfo.loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
-    depthAttachmentInfo.storeOp = VK_ATTACHMENT_STORE_OP_STORE;
-
-    VkRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_RENDERING_INFO};
-    renderingInfo.colorAttachmentCount = 1;
-    renderingInfo.pColorAttachments = &colorAttachmentInfo;
-    renderingInfo.pDepthAttachment = &depthAttachmentInfo;
-    renderingInfo.renderArea.extent = swapchainExtent;
-    renderingInfo.renderArea.offset = {0};
-    renderingInfo.layerCount = 1;
-
-    // Rendering begin
-    vkCmdBeginRendering(cmd, &renderingInfo);
-
-    // Setup dynamic state
-    vkutils::setViewport(cmd, 0.0f, 0.0f, swapchainExtent.width, swapchainExtent.height);
-    vkutils::setScissor(cmd, swapchainExtent);
+    std::lock_guard<std::mutex> lock(deletionMutex);
+    deletionQueue.push_back({frameNumber, std::move(destroy)});
 }
 
-void VulkanGraphics::beginFrame(VkCommandBuffer cmd, std::vector<std::pair<VkRenderingAttachmentInfo, Image>> &attachments, VkExtent2D extent)
+void VulkanGraphics::flushDeletionQueue(uint64_t completedFrame)
 {
-    std::vector<VkRenderingAttachmentInfo> colorAttachments;
-    std::vector<VkRenderingAttachmentInfo> depthAttachments;
-
-    // XXX: i dont know if this bariers are rightly placed
-    for (auto &attachment : attachments) {
-        if (attachment.first.imageLayout == VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL) {
-            colorAttachments.push_back(attachment.first);
-
-            vkutils::insertImageBarrier(
-                cmd, attachment.second.handle, 0, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-                {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-        } else if (attachment.first.imageLayout == VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL) {
-            depthAttachments.push_back(attachment.first);
-
-            vkutils::insertImageBarrier(
-                cmd, attachment.second.handle, 0, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT,
-                VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL,
-                VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
-                {VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1});
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(deletionMutex);
+        while (!deletionQueue.empty() && deletionQueue.front().frame <= completedFrame) {
+            ready.push_back(std::move(deletionQueue.front().destroy));
+            deletionQueue.pop_front();
         }
     }
 
-    VkRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_RENDERING_INFO};
-    renderingInfo.colorAttachmentCount = colorAttachments.size();
-    renderingInfo.pColorAttachments = colorAttachments.data();
-    renderingInfo.pDepthAttachment = depthAttachments.data();
-    renderingInfo.renderArea.extent = extent;
-    renderingInfo.renderArea.offset = {0};
-    renderingInfo.layerCount = 1;
+    // outside of the lock, destroys may defer more work
+    for (auto &destroy : ready)
+        destroy();
+}
+
+void VulkanGraphics::trackMemory(MemoryCategory category, int64_t bytes)
+{
+    categoryBytes[size_t(category)] += bytes;
+}
+
+void VulkanGraphics::setMemoryBudgetCallback(std::function<void(uint32_t heapIndex, VkDeviceSize usage, VkDeviceSize budget)> callback, float threshold)
+{
+    budgetCallback = std::move(callback);
+    budgetThreshold = threshold;
+}
+
+void VulkanGraphics::checkMemoryBudget()
+{
+    // VMA refreshes the budget from the driver on frame index change, called once per frame after frameNumber advanced
+    vmaSetCurrentFrameIndex(allocator, uint32_t(frameNumber));
+
+    if (!budgetCallback) return;
+
+    const VkPhysicalDeviceMemoryProperties *memoryProperties;
+    vmaGetMemoryProperties(allocator, &memoryProperties);
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(allocator, budgets);
+
+    for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+        bool over = budgets[i].usage > VkDeviceSize(budgets[i].budget * budgetThreshold);
+        if (over && !heapOverBudget[i])
+            budgetCallback(i, budgets[i].usage, budgets[i].budget);
+        heapOverBudget[i] = over;
+    }
+}
+
+void VulkanGraphics::drawMemoryImGui()
+{
+    const double MB = 1024.0 * 1024.0;
+
+    const VkPhysicalDeviceMemoryProperties *memoryProperties;
+    vmaGetMemoryProperties(allocator, &memoryProperties);
+    VmaBudget budgets[VK_MAX_MEMORY_HEAPS];
+    vmaGetHeapBudgets(allocator, budgets);
+    VmaTotalStatistics stats;
+    vmaCalculateStatistics(allocator, &stats);
+
+    ImGui::Text("Budget: %s", memoryBudgetSupported ? "VK_EXT_memory_budget" : "estimated");
+
+    // usage counts the whole process (other apps on the heap are in the budget), blocks are what VMA holds
+    for (uint32_t i = 0; i < memoryProperties->memoryHeapCount; i++) {
+        bool deviceLocal = memoryProperties->memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT;
+        VmaDetailedStatistics &heap = stats.memoryHeap[i];
+
+        ImGui::Text("Heap %u (%s)", i, deviceLocal ? "device" : "host");
+        float fraction = budgets[i].budget > 0 ? float(double(budgets[i].usage) / budgets[i].budget) : 0.0f;
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%.1f / %.1f MB", budgets[i].usage / MB, budgets[i].budget / MB);
+        ImGui::ProgressBar(fraction, ImVec2(-1.0f, 0.0f), overlay);
+        ImGui::Text("  VMA: %.1f MB in %u blocks, %.1f MB in %u allocations",
+            heap.statistics.blockBytes / MB, heap.statistics.blockCount, heap.statistics.allocationBytes / MB, heap.statistics.allocationCount);
+    }
 
-    // Rendering begin
-    vkCmdBeginRendering(cmd, &renderingInfo);
+    const char *categoryNames[] = {"Geometry", "Textures", "Shadow maps", "Render targets", "Dynamic", "Staging", "Other"};
+    static_assert(sizeof(categoryNames) / sizeof(categoryNames[0]) == size_t(MemoryCategory::Count));
 
-    // Setup dynamic state
-    vkutils::setViewport(cmd, 0.0f, 0.0f, extent.width, extent.height);
-    vkutils::setScissor(cmd, extent);
+    ImGui::Separator();
+    for (size_t i = 0; i < size_t(MemoryCategory::Count); i++)
+        ImGui::Text("%s: %.2f MB", categoryNames[i], categoryBytes[i].load() / MB);
 }
 
-void VulkanGraphics::endFrame(VkCommandBuffer cmd, bool insertBarrier)
+void VulkanGraphics::createThreadCommandPools(uint32_t threadCount)
 {
-    vkCmdEndRendering(cmd);
-
-    if (insertBarrier) {
-        // transition image for presentation
-        vkutils::insertImageBarrier(
-            cmd, swapchainImages[imageIndex], VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, 0,
-            VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_IMAGE_LAYOUT_PRESENT_SRC_KHR,
-            VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+    VkCommandPoolCreateInfo commandPoolInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolInfo.queueFamilyIndex = queueFamilyIndex;
+
+    for (auto &pools : threadCommandPools) {
+        pools.resize(threadCount);
+        for (auto &threadPool : pools)
+            VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &threadPool.pool));
     }
 }
 
-void VulkanGraphics::createBuffer(Buffer &buffer, uint64_t size, VkBufferUsageFlags usage, VmaMemoryUsage memUsage)
+VkCommandBuffer VulkanGraphics::beginSecondaryCommandBuffer(uint32_t threadIndex, const VkCommandBufferInheritanceRenderingInfo &renderingInfo)
+{
+    assert(threadIndex < threadCommandPools[currentFrame].size());
+    ThreadCommandPool &threadPool = threadCommandPools[currentFrame][threadIndex];
+
+    // buffers are kept after the pool reset and reused, new ones are allocated only when a thread needs more
+    if (threadPool.used == threadPool.secondaryBuffers.size()) {
+        VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        bufferAllocInfo.commandPool = threadPool.pool;
+        bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+        bufferAllocInfo.commandBufferCount = 1;
+
+        VkCommandBuffer buffer;
+        VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &buffer));
+        threadPool.secondaryBuffers.push_back(buffer);
+    }
+
+    VkCommandBuffer cmd = threadPool.secondaryBuffers[threadPool.used++];
+
+    VkCommandBufferInheritanceInfo inheritanceInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO};
+    inheritanceInfo.pNext = &renderingInfo;
+
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT | VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+    beginInfo.pInheritanceInfo = &inheritanceInfo;
+    VK_CHECK(vkBeginCommandBuffer(cmd, &beginInfo));
+
+    return cmd;
+}
+
+void VulkanGraphics::createBuffer(Buffer &buffer, uint64_t size, VkBufferUsageFlags usage, MemoryClass memoryClass)
 {
     VkBufferCreateInfo bufferInfo = {VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO};
     bufferInfo.size = size;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
     bufferInfo.usage = usage;
 
+    MemoryCategory category = MemoryCategory::Other;
+    if (memoryClass == MemoryClass::Staging || memoryClass == MemoryClass::Readback)
+        category = MemoryCategory::Staging;
+    else if (memoryClass == MemoryClass::Dynamic)
+        category = MemoryCategory::Dynamic;
+    else if (usage & (VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT))
+        category = MemoryCategory::Geometry;
+
     VmaAllocationCreateInfo allocInfo = {};
-    allocInfo.usage = memUsage;
-    allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
     allocInfo.priority = 1.0;
+    // category is read back from the allocation info on destroy
+    allocInfo.pUserData = reinterpret_cast<void*>(uintptr_t(category));
+
+    switch (memoryClass) {
+        case MemoryClass::DeviceStatic:
+            // no host access flags, so VMA never falls back to host visible memory the gpu reads over the bus
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE;
+            break;
+        case MemoryClass::Staging:
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+            break;
+        case MemoryClass::Dynamic:
+            // device local host visible memory (resizable BAR) when there is some, system memory otherwise
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
+            allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+            break;
+        case MemoryClass::Readback:
+            allocInfo.usage = VMA_MEMORY_USAGE_AUTO_PREFER_HOST;
+            allocInfo.flags = VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT;
+            break;
+    }
+
+    // buffers written by the transfer or compute queue are used by the graphics queue too
+    if ((usage & (VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)) && queueFamilies.size() > 1) {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        bufferInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
 
     VK_CHECK(vmaCreateBuffer(allocator, &bufferInfo, &allocInfo, &buffer.buffer, &buffer.allocation, &buffer.info));
+    trackMemory(category, buffer.info.size);
 
     if ((usage & VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) == VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT) {
         VkBufferDeviceAddressInfo deviceAddressInfo = {VK_STRUCTURE_TYPE_BUFFER_DEVICE_ADDRESS_INFO_KHR};
@@ -721,16 +1323,19 @@ void VulkanGraphics::createBuffer(Buffer &buffer, uint64_t size, VkBufferUsageFl
 
 void VulkanGraphics::destroyBuffer(Buffer &buffer)
 {
-    vmaDestroyBuffer(allocator, buffer.buffer, buffer.allocation);
+    destroyDeferred([this, handle = buffer.buffer, allocation = buffer.allocation, info = buffer.info]() {
+        trackMemory(MemoryCategory(uintptr_t(info.pUserData)), -int64_t(info.size));
+        vmaDestroyBuffer(allocator, handle, allocation);
+    });
 }
 
-void VulkanGraphics::createImage(Image &image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageViewType type, VkImageAspectFlags aspect, VkFilter filter, VkSamplerAddressMode samplerMode, bool cubemap)
+void VulkanGraphics::createImage(Image &image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageViewType type, VkImageAspectFlags aspect, const SamplerDesc &sampler, bool cubemap, uint32_t mipLevels)
 {
     VkImageCreateInfo imageInfo = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
     imageInfo.imageType = VK_IMAGE_TYPE_2D;
     imageInfo.format = format;
     imageInfo.extent = {width, height, 1};
-    imageInfo.mipLevels = 1;
+    imageInfo.mipLevels = mipLevels;
     imageInfo.arrayLayers = 1;
 
     if (cubemap) {
@@ -743,11 +1348,30 @@ void VulkanGraphics::createImage(Image &image, uint32_t width, uint32_t height,
     imageInfo.usage = usage;
     imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
+    // images written by the transfer or compute queue are used by the graphics queue too
+    if ((usage & (VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_STORAGE_BIT)) && queueFamilies.size() > 1) {
+        imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        imageInfo.queueFamilyIndexCount = static_cast<uint32_t>(queueFamilies.size());
+        imageInfo.pQueueFamilyIndices = queueFamilies.data();
+    }
+
+    // sampled depth targets are shadow maps
+    MemoryCategory category = MemoryCategory::Textures;
+    if ((usage & VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT) && (usage & VK_IMAGE_USAGE_SAMPLED_BIT))
+        category = MemoryCategory::ShadowMaps;
+    else if (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT))
+        category = MemoryCategory::RenderTargets;
+
     VmaAllocationCreateInfo allocInfo = {};
     allocInfo.usage = VMA_MEMORY_USAGE_AUTO;
-    allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+    allocInfo.pUserData = reinterpret_cast<void*>(uintptr_t(category));
+
+    // render targets get their own memory block, textures are sub-allocated
+    if (usage & (VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT))
+        allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
 
     vmaCreateImage(allocator, &imageInfo, &allocInfo, &image.handle, &image.allocation, &image.info);
+    trackMemory(category, image.info.size);
 
     VkImageViewCreateInfo imageViewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
     imageViewInfo.image = image.handle;
@@ -757,83 +1381,87 @@ void VulkanGraphics::createImage(Image &image, uint32_t width, uint32_t height,
     imageViewInfo.components.b = VK_COMPONENT_SWIZZLE_IDENTITY;
     imageViewInfo.components.a = VK_COMPONENT_SWIZZLE_IDENTITY;
     imageViewInfo.format = format;
-    imageViewInfo.subresourceRange = {aspect, 0, 1, 0, 1};
+    imageViewInfo.subresourceRange = {aspect, 0, mipLevels, 0, 1};
 
     if (cubemap)
         imageViewInfo.subresourceRange.layerCount = 6;
 
     vkCreateImageView(device, &imageViewInfo, nullptr, &image.view);
 
-    // TODO: make it configurable
-    image.sampler = createSampler(filter, filter, samplerMode);
+    image.sampler = getSampler(sampler);
 }
 
 void VulkanGraphics::destroyImage(Image &image)
 {
-    vmaDestroyImage(allocator, image.handle, image.allocation);
-    vkDestroyImageView(device, image.view, nullptr);
-    vkDestroySampler(device, image.sampler, nullptr);
+    destroyDeferred([this, handle = image.handle, view = image.view, allocation = image.allocation, info = image.info]() {
+        trackMemory(MemoryCategory(uintptr_t(info.pUserData)), -int64_t(info.size));
+        vkDestroyImageView(device, view, nullptr);
+        vmaDestroyImage(allocator, handle, allocation);
+    });
 }
 
 void VulkanGraphics::destroyTexture(Texture &texture)
 {
+    if (texture.slot != UINT32_MAX)
+        textureRegistry.remove(texture.slot);
     destroyImage(texture.image);
 }
 
-void VulkanGraphics::uploadBuffer(Buffer &buffer, void *data, VkDeviceSize size)
+void VulkanGraphics::destroyPipeline(VkPipeline pipeline, VkPipelineLayout layout)
 {
-    Buffer staging;
-    createBuffer(staging, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    memcpy(staging.info.pMappedData, data, size);
-    VK_CHECK(vmaFlushAllocation(allocator, staging.allocation, 0, VK_WHOLE_SIZE));
-
-    // create temporary command buffer
-    VkCommandBuffer copyCmd;
-    VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    bufferAllocInfo.commandPool = commandPool;
-    bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    bufferAllocInfo.commandBufferCount = 1;
-    VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &copyCmd));
+    destroyDeferred([this, pipeline, layout]() {
+        vkDestroyPipeline(device, pipeline, nullptr);
+        vkDestroyPipelineLayout(device, layout, nullptr);
+    });
+}
 
-    VkCommandBufferBeginInfo cmdBegin = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    VK_CHECK(vkBeginCommandBuffer(copyCmd, &cmdBegin));
+void VulkanGraphics::destroyDescriptors(VkDescriptorPool pool, VkDescriptorSetLayout setLayout)
+{
+    destroyDeferred([this, pool, setLayout]() {
+        vkDestroyDescriptorPool(device, pool, nullptr);
+        vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+    });
+}
 
-    // copy
-    VkBufferCopy copyRegion = {0, 0, size};
-    vkCmdCopyBuffer(copyCmd, staging.buffer, buffer.buffer, 1, &copyRegion);
+UploadToken VulkanGraphics::uploadBuffer(Buffer &buffer, void *data, VkDeviceSize size)
+{
+    return uploadQueue.uploadBuffer(buffer, data, size);
+}
 
-    VK_CHECK(vkEndCommandBuffer(copyCmd));
+void VulkanGraphics::flushUploads()
+{
+    uploadQueue.flush();
+}
 
-    // submit
-    VkSubmitInfo submit = {};
-    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.commandBufferCount = 1;
-    submit.pCommandBuffers = &copyCmd;
+VkSampler VulkanGraphics::getSampler(const SamplerDesc &desc)
+{
+    std::lock_guard<std::mutex> lock(samplerMutex);
 
-    VkFence fence = vkutils::createFence(device, 0);
-    VK_CHECK(vkQueueSubmit(queue, 1, &submit, fence));
-    VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, ~0L));
-    vkDestroyFence(device, fence, nullptr);
+    auto it = samplers.find(desc);
+    if (it != samplers.end())
+        return it->second;
 
-    destroyBuffer(staging);
-}
+    float anisotropy = std::min(desc.maxAnisotropy, maxSamplerAnisotropy);
 
-VkSampler VulkanGraphics::createSampler(VkFilter minFilter, VkFilter magFilter, VkSamplerAddressMode samplerMode)
-{
-    // TODO: add anisotropy feature
     VkSamplerCreateInfo createInfo = {VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO};
-    createInfo.magFilter = minFilter;
-    createInfo.minFilter = magFilter;
-    createInfo.addressModeU = samplerMode;
-    createInfo.addressModeV = samplerMode;
-    createInfo.addressModeW = samplerMode;
-    createInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    createInfo.compareOp = VK_COMPARE_OP_NEVER;
-    createInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    createInfo.magFilter = desc.magFilter;
+    createInfo.minFilter = desc.minFilter;
+    createInfo.mipmapMode = desc.mipmapMode;
+    createInfo.addressModeU = desc.addressMode;
+    createInfo.addressModeV = desc.addressMode;
+    createInfo.addressModeW = desc.addressMode;
+    createInfo.anisotropyEnable = anisotropy > 1.0f ? VK_TRUE : VK_FALSE;
+    createInfo.maxAnisotropy = anisotropy;
+    createInfo.compareEnable = desc.compareEnable;
+    createInfo.compareOp = desc.compareOp;
+    createInfo.minLod = desc.minLod;
+    createInfo.maxLod = desc.maxLod;
+    createInfo.borderColor = desc.borderColor;
 
     VkSampler sampler;
     VK_CHECK(vkCreateSampler(device, &createInfo, nullptr, &sampler));
 
+    samplers[desc] = sampler;
     return sampler;
 }
 
@@ -854,69 +1482,20 @@ void VulkanGraphics::loadTextureInfo(TextureInfo &textureInfo, const char *file)
     textureInfo.loaded = true;
 }
 
-void VulkanGraphics::createTexture(Texture &texture, TextureInfo &info, VkFormat format)
+UploadToken VulkanGraphics::createTexture(Texture &texture, TextureInfo &info, VkFormat format)
 {
     uint32_t size = info.width * info.height * info.channels;
 
-    createImage(texture.image, info.width, info.height, format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT);
-
-    Buffer staging;
-    createBuffer(staging, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-    memcpy(staging.info.pMappedData, info.pixels, size);
-
-    // create temporary command buffer
-    VkCommandBuffer copyCmd;
-    VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    bufferAllocInfo.commandPool = commandPool;
-    bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    bufferAllocInfo.commandBufferCount = 1;
-    VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &copyCmd));
-
-    VkCommandBufferBeginInfo cmdBegin = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    VK_CHECK(vkBeginCommandBuffer(copyCmd, &cmdBegin));
+    SamplerDesc sampler;
+    sampler.maxAnisotropy = 16.0f;
+    createImage(texture.image, info.width, info.height, format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_VIEW_TYPE_2D, VK_IMAGE_ASPECT_COLOR_BIT, sampler);
+    // NOTE: the upload is waited for by the frame submit, before any frame can sample the slot
+    texture.slot = textureRegistry.add(texture.image.view, texture.image.sampler);
 
-    // transition image to transfer
-    vkutils::insertImageBarrier(
-        copyCmd,
-        texture.image.handle,
-        0, VK_ACCESS_TRANSFER_WRITE_BIT,
-        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-        VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-
-    // copy
-    VkBufferImageCopy copyRegion = {};
-    copyRegion.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
-    copyRegion.imageExtent = {static_cast<uint32_t>(info.width), static_cast<uint32_t>(info.height), 1};
-
-    vkCmdCopyBufferToImage(copyCmd, staging.buffer, texture.image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copyRegion);
-
-    // transition image to fragment shader
-    vkutils::insertImageBarrier(
-        copyCmd,
-        texture.image.handle,
-        VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
-        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
-
-    VK_CHECK(vkEndCommandBuffer(copyCmd));
-
-    // submit
-    VkSubmitInfo submit = {};
-    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.commandBufferCount = 1;
-    submit.pCommandBuffers = &copyCmd;
-
-    VkFence fence = vkutils::createFence(device, 0);
-    VK_CHECK(vkQueueSubmit(queue, 1, &submit, fence));
-    VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, ~0L));
-    vkDestroyFence(device, fence, nullptr);
-
-    destroyBuffer(staging);
+    return uploadQueue.uploadImage(texture.image, info.pixels, size, info.width, info.height);
 }
 
-void VulkanGraphics::createTextureCubemap(Texture &texture, std::filesystem::path dir, VkFormat format)
+UploadToken VulkanGraphics::createTextureCubemap(Texture &texture, std::filesystem::path dir, VkFormat format)
 {
     std::filesystem::path paths[6] = {"right.jpg", "left.jpg", "top.jpg", "bottom.jpg", "front.jpg", "back.jpg"};
 
@@ -932,71 +1511,16 @@ void VulkanGraphics::createTextureCubemap(Texture &texture, std::filesystem::pat
     uint32_t size = infos[0].width * infos[0].height * STBI_rgb_alpha * 6;
     uint32_t layerSize = size / 6;
 
-    createImage(texture.image, infos[0].width, infos[0].height, format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_VIEW_TYPE_CUBE, VK_IMAGE_ASPECT_COLOR_BIT, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE, true);
-
-    Buffer staging;
-    createBuffer(staging, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-
-    for (uint32_t face = 0; face < 6; face++) {
-        memcpy(static_cast<unsigned char*>(staging.info.pMappedData) + (layerSize * face), infos[face].pixels, layerSize);
-    }
-
-    // create temporary command buffer
-    VkCommandBuffer copyCmd;
-    VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
-    bufferAllocInfo.commandPool = commandPool;
-    bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    bufferAllocInfo.commandBufferCount = 1;
-    VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &copyCmd));
-
-    VkCommandBufferBeginInfo cmdBegin = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
-    VK_CHECK(vkBeginCommandBuffer(copyCmd, &cmdBegin));
+    SamplerDesc sampler;
+    sampler.addressMode = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    createImage(texture.image, infos[0].width, infos[0].height, format, VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_IMAGE_VIEW_TYPE_CUBE, VK_IMAGE_ASPECT_COLOR_BIT, sampler, true);
 
-    // transition image to transfer
-    vkutils::insertImageBarrier(
-            copyCmd,
-            texture.image.handle,
-            0, VK_ACCESS_TRANSFER_WRITE_BIT,
-            VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-            VK_PIPELINE_STAGE_HOST_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 6});
-
-    // copy
-    std::vector<VkBufferImageCopy> copyRegions;
+    std::vector<unsigned char> pixels(size);
     for (uint32_t face = 0; face < 6; face++) {
-        VkBufferImageCopy copyRegion = {};
-        copyRegion.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, face, 1};
-        copyRegion.imageExtent = {static_cast<uint32_t>(infos[face].width), static_cast<uint32_t>(infos[face].height), 1};
-        copyRegion.bufferOffset = face * layerSize;
-        copyRegions.push_back(copyRegion);
+        memcpy(pixels.data() + (layerSize * face), infos[face].pixels, layerSize);
     }
 
-    vkCmdCopyBufferToImage(copyCmd, staging.buffer, texture.image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegions.size(), copyRegions.data());
-
-    // transition image to fragment shader
-    vkutils::insertImageBarrier(
-            copyCmd,
-            texture.image.handle,
-            VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
-            VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-            VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-            {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 6});
-
-    VK_CHECK(vkEndCommandBuffer(copyCmd));
-
-    // submit
-    VkSubmitInfo submit = {};
-    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-    submit.commandBufferCount = 1;
-    submit.pCommandBuffers = &copyCmd;
-
-    VkFence fence = vkutils::createFence(device, 0);
-    VK_CHECK(vkQueueSubmit(queue, 1, &submit, fence));
-    VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, ~0L));
-    vkDestroyFence(device, fence, nullptr);
-
-    destroyBuffer(staging);
+    return uploadQueue.uploadImage(texture.image, pixels.data(), size, infos[0].width, infos[0].height, 6);
 }
 
 void VulkanGraphics::initImGui()
@@ -1014,12 +1538,10 @@ void VulkanGraphics::initImGui()
     };
     imGuiDesctiptorPool = vkutils::createDescriptorPool(device, poolSizes);
 
-    VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB; // TODO: change hardcoded format
-
     VkPipelineRenderingCreateInfoKHR pipelineRenderingCI = {VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR};
     pipelineRenderingCI.colorAttachmentCount = 1;
-    pipelineRenderingCI.pColorAttachmentFormats = &colorFormat;
-    pipelineRenderingCI.depthAttachmentFormat = VK_FORMAT_D32_SFLOAT;
+    pipelineRenderingCI.pColorAttachmentFormats = &swapchainFormat;
+    pipelineRenderingCI.depthAttachmentFormat = depthFormat;
 
     // Setup Platform/Renderer backends
     ImGui_ImplGlfw_InitForVulkan(pWindow, true);
@@ -1047,3 +1569,76 @@ void VulkanGraphics::requestResize()
 {
     resizeRequested = true;
 }
+
+void VulkanGraphics::setPresentMode(VkPresentModeKHR presentMode)
+{
+    if (settings.headless) return;
+
+    settings.presentMode = presentMode;
+    resizeRequested = true;
+}
+
+void VulkanGraphics::readback(std::vector<unsigned char> &pixels)
+{
+    assert(settings.headless);
+
+    // last submitted frame rendered into its own offscreen image
+    uint32_t frame = (currentFrame + FRAMES_IN_FLIGHT - 1) % FRAMES_IN_FLIGHT;
+    VK_CHECK(vkWaitForFences(device, 1, &finishRenderFences[frame], VK_TRUE, ~0ull));
+
+    VkDeviceSize size = swapchainExtent.width * swapchainExtent.height * 4;
+
+    Buffer staging;
+    createBuffer(staging, size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, MemoryClass::Readback);
+
+    // create temporary command buffer
+    VkCommandBuffer copyCmd;
+    VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+    bufferAllocInfo.commandPool = commandPool;
+    bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    bufferAllocInfo.commandBufferCount = 1;
+    VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &copyCmd));
+
+    VkCommandBufferBeginInfo cmdBegin = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    cmdBegin.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(copyCmd, &cmdBegin));
+
+    // make color writes of the frame visible to the copy, the image is already in transfer src layout
+    vkutils::insertImageBarrier(
+        copyCmd, swapchainImages[frame],
+        VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+        presentLayout, presentLayout,
+        VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1});
+
+    VkBufferImageCopy copyRegion = {};
+    copyRegion.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1};
+    copyRegion.imageExtent = {swapchainExtent.width, swapchainExtent.height, 1};
+    vkCmdCopyImageToBuffer(copyCmd, swapchainImages[frame], presentLayout, staging.buffer, 1, &copyRegion);
+
+    VkMemoryBarrier hostBarrier = {VK_STRUCTURE_TYPE_MEMORY_BARRIER};
+    hostBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    hostBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(copyCmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &hostBarrier, 0, nullptr, 0, nullptr);
+
+    VK_CHECK(vkEndCommandBuffer(copyCmd));
+
+    // submit
+    VkSubmitInfo submit = {};
+    submit.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &copyCmd;
+
+    VkFence fence = vkutils::createFence(device, 0);
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit, fence));
+    VK_CHECK(vkWaitForFences(device, 1, &fence, VK_TRUE, ~0ull));
+    vkDestroyFence(device, fence, nullptr);
+    vkFreeCommandBuffers(device, commandPool, 1, &copyCmd);
+
+    pixels.resize(size);
+    // readback memory may be cached and not coherent
+    VK_CHECK(vmaInvalidateAllocation(allocator, staging.allocation, 0, VK_WHOLE_SIZE));
+    memcpy(pixels.data(), staging.info.pMappedData, size);
+
+    destroyBuffer(staging);
+}
@@ -2,57 +2,187 @@
 
 #include <vector>
 #include <array>
+#include <functional>
 #include <volk.h>
 #include "vk_mem_alloc.h"
 #include <GLFW/glfw3.h>
 #include <revival/vulkan/resources.h>
 #include <revival/vulkan/common.h>
+#include <revival/vulkan/upload_queue.h>
+#include <revival/vulkan/texture_registry.h>
 #include <filesystem>
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <unordered_map>
 
 const int MAX_IMGUI_TEXTURES = 1000;
 const int FRAMES_IN_FLIGHT = 2;
+const char *const PIPELINE_CACHE_PATH = "build/pipeline_cache.bin";
+
+// where a buffer is placed and how the cpu reaches it
+enum class MemoryClass
+{
+    // filled through uploadBuffer and only read by the gpu afterwards (geometry), never mapped
+    DeviceStatic,
+    // cpu writes sequentially, gpu copies from it
+    Staging,
+    // cpu rewrites it every frame and the gpu reads it in place, persistently mapped
+    Dynamic,
+    // gpu writes, cpu reads, persistently mapped and cached where possible
+    Readback,
+};
+
+// totals of the memory report, derived from the buffer memory class and image usage
+enum class MemoryCategory
+{
+    Geometry,
+    Textures,
+    ShadowMaps,
+    RenderTargets,
+    Dynamic,
+    Staging,
+    Other,
+    Count,
+};
+
+struct GraphicsSettings
+{
+    // render into offscreen images instead of a window swapchain, window can be null
+    bool headless = false;
+    // size of the offscreen images, window framebuffer size is used otherwise
+    uint32_t width = 1280;
+    uint32_t height = 720;
+
+    // FIFO is always supported and is used when the surface doesn't support the requested mode
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    // 0 uses minImageCount + 1, clamped to the surface limits
+    uint32_t imageCount = 0;
+
+    // picks a physical device instead of the best scored one, by enumeration index or by part of its name (has to outlive init).
+    // Devices without the required features are never picked.
+    int32_t deviceIndex = -1;
+    const char *deviceName = nullptr;
+};
+
+// optional features of a physical device, device selection scores them and optional paths enable themselves from them
+struct DeviceCapabilities
+{
+    char name[VK_MAX_PHYSICAL_DEVICE_NAME_SIZE] = {};
+    VkPhysicalDeviceType type = VK_PHYSICAL_DEVICE_TYPE_OTHER;
+    uint32_t apiVersion = 0;
+    // sum of device local heaps
+    VkDeviceSize vram = 0;
+
+    bool memoryBudget = false;
+    bool timestampQueries = false;
+    bool multiview = false;
+    bool extendedDynamicState = false;
+    // extended dynamic state through VK_EXT_extended_dynamic_state instead of vk 1.3
+    bool extendedDynamicStateExtension = false;
+    bool samplerAnisotropy = false;
+    // GPU driven draws need all three, the renderer records draws on the cpu without them
+    bool multiDrawIndirect = false;
+    bool drawIndirectFirstInstance = false;
+    bool drawIndirectCount = false;
+
+    uint32_t score = 0;
+};
 
 class VulkanGraphics
 {
 public:
-    void init(GLFWwindow *window);
+    void init(GLFWwindow *window, GraphicsSettings graphicsSettings = {});
     void shutdown();
 
     VkCommandBuffer beginCommandBuffer();
     void endCommandBuffer(VkCommandBuffer cmd);
     void submitCommandBuffer(VkCommandBuffer cmd);
 
-    void beginFrame(VkCommandBuffer cmd);
-    void beginFrame(VkCommandBuffer cmd, Image &depthImage);
-    void beginFrame(VkCommandBuffer cmd, std::vector<std::pair<VkRenderingAttachmentInfo, Image>> &attachments, VkExtent2D extent);
+    // Secondary command buffers for multithreaded recording. Every thread has its own pool per frame in flight,
+    // pools are reset in beginCommandBuffer, so the buffers are valid only for the current frame.
+    void createThreadCommandPools(uint32_t threadCount);
+    VkCommandBuffer beginSecondaryCommandBuffer(uint32_t threadIndex, const VkCommandBufferInheritanceRenderingInfo &renderingInfo);
 
-    // TODO: add variation of endFrame with arbitrary number of barriers passed to it
-    void endFrame(VkCommandBuffer cmd, bool insertBarrier = true);
+    // Compute work of the current frame, only between beginCommandBuffer and submitCommandBuffer. It runs on a separate
+    // compute queue when the device has one, the frame submit waits for it at graphicsWaitStages, so graphics work in
+    // earlier stages overlaps it. Without a separate queue it is submitted to the graphics queue and runs before the frame.
+    // NOTE: frames in flight overlap too, resources written by compute and read by graphics need per frame copies.
+    // Unless previousFrameWaitStages is set, then those compute stages wait for the graphics work of the previous frame,
+    // which no longer overlaps this submit.
+    VkCommandBuffer beginComputeCommandBuffer();
+    void submitComputeCommandBuffer(VkCommandBuffer cmd, VkPipelineStageFlags graphicsWaitStages, VkPipelineStageFlags previousFrameWaitStages);
 
     // resource creation
-    void createBuffer(Buffer &buffer, uint64_t size, VkBufferUsageFlags usage, VmaMemoryUsage memUsage = VMA_MEMORY_USAGE_AUTO);
-    void createImage(Image &image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageViewType type, VkImageAspectFlags aspect, VkFilter filter = VK_FILTER_LINEAR, VkSamplerAddressMode samplerMode = VK_SAMPLER_ADDRESS_MODE_REPEAT, bool cubemap = false);
+    void createBuffer(Buffer &buffer, uint64_t size, VkBufferUsageFlags usage, MemoryClass memoryClass);
+    // the view covers every mip level
+    void createImage(Image &image, uint32_t width, uint32_t height, VkFormat format, VkImageUsageFlags usage, VkImageViewType type, VkImageAspectFlags aspect, const SamplerDesc &sampler = {}, bool cubemap = false, uint32_t mipLevels = 1);
 
+    // Destruction is deferred until every frame that could still use the resource has finished, so resources can be
+    // unloaded at any point of a frame without waiting for the device. The handles may be reused by the caller right away.
     void destroyBuffer(Buffer &buffer);
     void destroyImage(Image &image);
     void destroyTexture(Texture &texture);
+    // layout is optional, pipelines can share one
+    void destroyPipeline(VkPipeline pipeline, VkPipelineLayout layout = VK_NULL_HANDLE);
+    void destroyDescriptors(VkDescriptorPool pool, VkDescriptorSetLayout setLayout);
+
+    // runs destroy once every frame begun so far has finished, for resources the gpu may still use. Thread safe.
+    void destroyDeferred(std::function<void()> destroy);
+
+    // memory allocated outside createBuffer/createImage (render graph transients), bytes can be negative on free
+    void trackMemory(MemoryCategory category, int64_t bytes);
+
+    // called once when a heap goes over threshold * budget, again only after it dropped below it.
+    // Budgets come from VK_EXT_memory_budget when supported, otherwise VMA estimates them from the heap size.
+    void setMemoryBudgetCallback(std::function<void(uint32_t heapIndex, VkDeviceSize usage, VkDeviceSize budget)> callback, float threshold = 0.9f);
+    void drawMemoryImGui();
 
-    void uploadBuffer(Buffer &buffer, void *data, VkDeviceSize size);
+    // uploads are asynchronous, every frame submit waits for the uploads recorded before it.
+    // The token can be used to check for completion if data is consumed outside of frames.
+    UploadToken uploadBuffer(Buffer &buffer, void *data, VkDeviceSize size);
+    void flushUploads();
 
-    VkSampler createSampler(VkFilter minFilter, VkFilter magFilter, VkSamplerAddressMode samplerMode);
+    // samplers are cached by their whole state and live until shutdown, callers never destroy them
+    VkSampler getSampler(const SamplerDesc &desc);
+    uint32_t getSamplerCount() { return samplers.size(); };
 
     void loadTextureInfo(TextureInfo &textureInfo, const char *file);
-    void createTexture(Texture &texture, TextureInfo &info, VkFormat format);
-    void createTextureCubemap(Texture &texture, std::filesystem::path dir, VkFormat format);
+    UploadToken createTexture(Texture &texture, TextureInfo &info, VkFormat format);
+    UploadToken createTextureCubemap(Texture &texture, std::filesystem::path dir, VkFormat format);
 
     void requestResize();
 
+    // swapchain is recreated with the new mode after the current frame is presented
+    void setPresentMode(VkPresentModeKHR presentMode);
+
+    // copies the last submitted frame into pixels (BGRA8), waits for the frame to finish. Headless only.
+    void readback(std::vector<unsigned char> &pixels);
+
     // getters
     VkDevice getDevice() { return device; };
+    VkPhysicalDevice getPhysicalDevice() { return physicalDevice; };
+    const DeviceCapabilities &getCapabilities() { return capabilities; };
+    uint32_t getQueueFamilyIndex() { return queueFamilyIndex; };
+    uint32_t getComputeQueueFamilyIndex() { return computeQueueFamilyIndex; };
+    bool hasAsyncCompute() { return asyncCompute; };
+    bool isHeadless() { return settings.headless; };
+    VmaAllocator getAllocator() { return allocator; };
+    UploadQueue &getUploadQueue() { return uploadQueue; };
+    TextureRegistry &getTextureRegistry() { return textureRegistry; };
+    VkPipelineCache getPipelineCache() { return pipelineCache; };
+    bool isPipelineCacheWarm() { return pipelineCacheWarm; };
+    uint32_t getCurrentFrame() { return currentFrame; };
     VkExtent2D getSwapchainExtent() { return swapchainExtent; };
+    // attachment formats of the final image and the scene depth, pipelines and secondary buffers drawing into them use these
+    VkFormat getSwapchainFormat() { return swapchainFormat; };
+    VkFormat getDepthFormat() { return depthFormat; };
+    VkPresentModeKHR getPresentMode() { return presentMode; };
+    std::vector<VkPresentModeKHR> &getSupportedPresentModes() { return supportedPresentModes; };
     VkImage &getSwapchainImage() { return swapchainImages[imageIndex]; };
-    Image &getDepthImage() { return depthImage; };
     VkImageView &getSwapchainImageView() { return swapchainImageViews[imageIndex]; };
+    // layout the final image has to be left in at the end of the frame
+    VkImageLayout getPresentLayout() { return presentLayout; };
 private:
     VkInstance createInstance();
     VkSurfaceKHR createSurface(VkInstance instance, GLFWwindow *window);
@@ -60,19 +190,31 @@ private:
     VmaAllocator createAllocator(VkInstance instance, VkDevice device, VkPhysicalDevice physicalDevice, VmaAllocatorCreateFlags flags);
 
     VkPhysicalDevice createPhyiscalDevice(VkInstance instance, VkSurfaceKHR surface, uint32_t &queueFamilyIndex);
-    VkDevice createDevice(VkInstance instance, VkSurfaceKHR surface, VkPhysicalDevice physical, uint32_t queueFamilyIndex);
+    DeviceCapabilities queryCapabilities(VkPhysicalDevice physicalDevice, uint32_t queueFamilyIndex);
+    void printCapabilities(const DeviceCapabilities &caps);
+    uint32_t findTransferQueueFamily(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex, uint32_t &queueIndex);
+    uint32_t findComputeQueueFamily(VkPhysicalDevice physicalDevice, uint32_t graphicsQueueFamilyIndex, uint32_t transferQueueFamilyIndex, uint32_t transferQueueIndex, uint32_t &queueIndex);
+    VkDevice createDevice(VkInstance instance, VkSurfaceKHR surface, VkPhysicalDevice physical, uint32_t queueFamilyIndex, uint32_t transferQueueFamilyIndex, uint32_t transferQueueIndex, uint32_t computeQueueFamilyIndex, uint32_t computeQueueIndex);
 
-    VkSwapchainKHR createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t queueFamilyIndex, GLFWwindow *window, VkExtent2D &swapchainExtent);
+    VkSwapchainKHR createSwapchain(VkDevice device, VkPhysicalDevice physicalDevice, VkSurfaceKHR surface, uint32_t queueFamilyIndex, GLFWwindow *window, VkExtent2D &swapchainExtent, VkSwapchainKHR oldSwapchain = VK_NULL_HANDLE);
     std::vector<VkImageView> createSwapchainImageViews(VkDevice device, std::vector<VkImage> &swapchainImages);
+    void createOffscreenImages();
+
+    VkPipelineCache createPipelineCache(VkDevice device, VkPhysicalDevice physicalDevice, const char *path);
+    void savePipelineCache(const char *path);
 
     VkCommandPool createCommandPool(VkDevice device, uint32_t queueFamilyIndex);
     std::array<VkCommandBuffer, FRAMES_IN_FLIGHT> createCommandBuffers(VkDevice device, VkCommandPool commandPool);
 
     void recreateSwapchain();
+    // runs deferred destroys of frames up to and including completedFrame
+    void flushDeletionQueue(uint64_t completedFrame);
+    void checkMemoryBudget();
 
     void initImGui();
 private:
     GLFWwindow *pWindow;
+    GraphicsSettings settings;
 
     VkInstance instance;
     VkSurfaceKHR surface;
@@ -84,26 +226,109 @@ private:
     VkPhysicalDevice physicalDevice;
     VkDevice device;
 
+    // of the selected physical device
+    DeviceCapabilities capabilities;
+
+    // 1 if samplerAnisotropy is not supported
+    float maxSamplerAnisotropy = 1.0f;
+
+    // images are created from pipeline jobs too
+    std::mutex samplerMutex;
+    std::unordered_map<SamplerDesc, VkSampler, SamplerDescHash> samplers;
+
+    bool memoryBudgetSupported = false;
+    std::array<std::atomic<int64_t>, size_t(MemoryCategory::Count)> categoryBytes = {};
+    std::function<void(uint32_t heapIndex, VkDeviceSize usage, VkDeviceSize budget)> budgetCallback;
+    float budgetThreshold = 0.9f;
+    std::array<bool, VK_MAX_MEMORY_HEAPS> heapOverBudget = {};
+
     uint32_t queueFamilyIndex;
     VkQueue queue;
 
+    // dedicated transfer family if there is one, otherwise second queue (or the same queue) of the graphics family
+    uint32_t transferQueueFamilyIndex;
+    uint32_t transferQueueIndex;
+    VkQueue transferQueue;
+
+    // compute only family if there is one, otherwise another queue of the graphics family.
+    // Without any queue left it is the graphics queue itself and asyncCompute is false.
+    uint32_t computeQueueFamilyIndex;
+    uint32_t computeQueueIndex;
+    VkQueue computeQueue;
+    bool asyncCompute = false;
+
+    // unique queue families, resources written by the transfer or compute queue are shared between them
+    std::vector<uint32_t> queueFamilies;
+
+    UploadQueue uploadQueue;
+    TextureRegistry textureRegistry;
+
+    // shared by every pipeline, persisted between runs
+    VkPipelineCache pipelineCache;
+    bool pipelineCacheWarm = false;
+
     VkSwapchainKHR swapchain;
     VkExtent2D swapchainExtent;
+    VkFormat swapchainFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
+    VkPresentModeKHR presentMode = VK_PRESENT_MODE_FIFO_KHR;
+    std::vector<VkPresentModeKHR> supportedPresentModes;
     std::vector<VkImage> swapchainImages;
     std::vector<VkImageView> swapchainImageViews;
 
+    // headless mode renders into these, their handles and views are exposed through swapchainImages/swapchainImageViews
+    std::vector<Image> offscreenImages;
+    // layout of the final image at the end of the frame
+    VkImageLayout presentLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
     VkCommandPool commandPool;
     std::array<VkCommandBuffer, FRAMES_IN_FLIGHT> commandBuffers;
 
+    struct ThreadCommandPool
+    {
+        VkCommandPool pool;
+        std::vector<VkCommandBuffer> secondaryBuffers;
+        uint32_t used = 0;
+    };
+    // [frame][thread]
+    std::array<std::vector<ThreadCommandPool>, FRAMES_IN_FLIGHT> threadCommandPools;
+
+    struct ComputeCommandPool
+    {
+        VkCommandPool pool;
+        std::vector<VkCommandBuffer> buffers;
+        uint32_t used = 0;
+    };
+    // reset with the frame, the frame fence covers the compute work because the frame submit waited for it
+    std::array<ComputeCommandPool, FRAMES_IN_FLIGHT> computeCommandPools;
+
+    // signaled by every compute submit, the next frame submit waits for the last value at computeWaitStages
+    VkSemaphore computeSemaphore;
+    uint64_t computeValue = 0;
+    VkPipelineStageFlags computeWaitStages = 0;
+    // signaled by every frame submit, compute submits wait for the last value when they consume the previous frame
+    VkSemaphore graphicsSemaphore;
+    uint64_t graphicsValue = 0;
+
     std::array<VkSemaphore, FRAMES_IN_FLIGHT> acquireSemaphores;
     std::array<VkSemaphore, FRAMES_IN_FLIGHT> submitSemaphores;
     std::array<VkFence, FRAMES_IN_FLIGHT> finishRenderFences;
 
+    struct DeferredDestroy
+    {
+        // last frame that could use the resource
+        uint64_t frame;
+        std::function<void()> destroy;
+    };
+    // in push order, so frames are ascending. Flushed after the fence of a frame slot is waited for.
+    std::deque<DeferredDestroy> deletionQueue;
+    std::mutex deletionMutex;
+    // frames begun so far, the one being recorded has this number
+    uint64_t frameNumber = 0;
+
     uint32_t imageIndex = 0;
     uint32_t currentFrame = 0;
 
-    Image depthImage;
-
     bool resizeRequested = false;
 
     VkDescriptorPool imGuiDesctiptorPool;
@@ -127,6 +127,17 @@ void PipelineBuilder::setPatchControlPoints(uint32_t points)
     tessellationState.patchControlPoints = points;
 }
 
+void PipelineBuilder::setPipelineCache(VkPipelineCache cache)
+{
+    pipelineCache = cache;
+}
+
+void PipelineBuilder::setAttachmentFormats(VkFormat color, VkFormat depth)
+{
+    colorFormat = color;
+    depthFormat = depth;
+}
+
 VkPipeline PipelineBuilder::build(VkDevice device, uint32_t colorAttachmentCount, bool depthUsed)
 {
     vertexInputState.vertexAttributeDescriptionCount = attributeDescriptions.size();
@@ -145,9 +156,6 @@ VkPipeline PipelineBuilder::build(VkDevice device, uint32_t colorAttachmentCount
         colorBlendState.pAttachments = &colorBlendAttachment;
     }
 
-    VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB;
-    VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
-
     VkPipelineRenderingCreateInfoKHR renderingInfo = {VK_STRUCTURE_TYPE_PIPELINE_RENDERING_CREATE_INFO_KHR};
     renderingInfo.colorAttachmentCount = colorAttachmentCount;
     renderingInfo.pColorAttachmentFormats = &colorFormat;
@@ -171,6 +179,6 @@ VkPipeline PipelineBuilder::build(VkDevice device, uint32_t colorAttachmentCount
     pipelineInfo.renderPass = nullptr;
 
     VkPipeline pipeline;
-    VK_CHECK(vkCreateGraphicsPipelines(device, 0, 1, &pipelineInfo, nullptr, &pipeline));
+    VK_CHECK(vkCreateGraphicsPipelines(device, pipelineCache, 1, &pipelineInfo, nullptr, &pipeline));
     return pipeline;
 }
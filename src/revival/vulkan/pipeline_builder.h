@@ -21,6 +21,10 @@ public:
     void setTopology(VkPrimitiveTopology topology);
     void setPatchControlPoints(uint32_t points);
 
+    void setPipelineCache(VkPipelineCache cache);
+    // formats of the attachments the pipeline renders into, passes drawing into the swapchain pass VulkanGraphics' formats
+    void setAttachmentFormats(VkFormat color, VkFormat depth);
+
     VkPipeline build(VkDevice device, uint32_t colorAttachmentCount = 1, bool depthUsed = true);
 
 private:
@@ -39,4 +43,7 @@ private:
     VkPipelineColorBlendStateCreateInfo colorBlendState;
     VkPipelineDynamicStateCreateInfo dynamicState;
     VkPipelineLayout pipelineLayout;
+    VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+    VkFormat colorFormat = VK_FORMAT_B8G8R8A8_SRGB;
+    VkFormat depthFormat = VK_FORMAT_D32_SFLOAT;
 };
@@ -0,0 +1,752 @@
+#include <revival/vulkan/render_graph.h>
+#include <revival/vulkan/graphics.h>
+#include <revival/vulkan/gpu_profiler.h>
+#include <revival/vulkan/utils.h>
+#include <revival/profiler.h>
+#include <algorithm>
+#include <numeric>
+
+#include "imgui.h"
+
+static const VkAccessFlags WRITE_ACCESS =
+    VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+    VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_HOST_WRITE_BIT | VK_ACCESS_MEMORY_WRITE_BIT;
+
+struct UsageInfo
+{
+    VkImageLayout layout;
+    VkPipelineStageFlags stage;
+    VkAccessFlags readAccess;
+    VkAccessFlags writeAccess;
+};
+
+static UsageInfo getImageUsageInfo(ImageUsage usage)
+{
+    switch (usage) {
+        case ImageUsage::ColorAttachment:
+            return {VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_ACCESS_COLOR_ATTACHMENT_READ_BIT, VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT};
+        case ImageUsage::DepthAttachment:
+            return {VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT, VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT};
+        case ImageUsage::SampledFragment:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0};
+        case ImageUsage::SampledCompute:
+            return {VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, 0};
+        case ImageUsage::StorageCompute:
+            return {VK_IMAGE_LAYOUT_GENERAL, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT};
+        case ImageUsage::TransferSrc:
+            return {VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0};
+        case ImageUsage::TransferDst:
+            return {VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT};
+    }
+
+    assert(false);
+    return {};
+}
+
+static UsageInfo getBufferUsageInfo(BufferUsage usage)
+{
+    switch (usage) {
+        case BufferUsage::IndexBuffer:
+            return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, VK_ACCESS_INDEX_READ_BIT, 0};
+        case BufferUsage::IndirectBuffer:
+            return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, VK_ACCESS_INDIRECT_COMMAND_READ_BIT, 0};
+        case BufferUsage::StorageGraphics:
+            return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT};
+        case BufferUsage::StorageCompute:
+            return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_SHADER_WRITE_BIT};
+        case BufferUsage::TransferSrc:
+            return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_ACCESS_TRANSFER_READ_BIT, 0};
+        case BufferUsage::TransferDst:
+            return {VK_IMAGE_LAYOUT_UNDEFINED, VK_PIPELINE_STAGE_TRANSFER_BIT, 0, VK_ACCESS_TRANSFER_WRITE_BIT};
+    }
+
+    assert(false);
+    return {};
+}
+
+static VkImageUsageFlags getImageUsageFlags(ImageUsage usage)
+{
+    switch (usage) {
+        case ImageUsage::ColorAttachment: return VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT;
+        case ImageUsage::DepthAttachment: return VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+        case ImageUsage::SampledFragment: return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case ImageUsage::SampledCompute: return VK_IMAGE_USAGE_SAMPLED_BIT;
+        case ImageUsage::StorageCompute: return VK_IMAGE_USAGE_STORAGE_BIT;
+        case ImageUsage::TransferSrc: return VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+        case ImageUsage::TransferDst: return VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+    }
+
+    assert(false);
+    return 0;
+}
+
+static bool isAttachment(bool image, uint32_t usage)
+{
+    return image && (usage == uint32_t(ImageUsage::ColorAttachment) || usage == uint32_t(ImageUsage::DepthAttachment));
+}
+
+static const char *getLoadOpName(VkAttachmentLoadOp op)
+{
+    switch (op) {
+        case VK_ATTACHMENT_LOAD_OP_LOAD: return "load";
+        case VK_ATTACHMENT_LOAD_OP_CLEAR: return "clear";
+        default: return "dont care";
+    }
+}
+
+//
+// Pass
+//
+void RenderGraph::Pass::writeColor(RGImage image, bool clear, VkClearColorValue clearValue)
+{
+    Access access = {image.index, true, true, uint32_t(ImageUsage::ColorAttachment), clear};
+    access.clearValue.color = clearValue;
+    accesses.push_back(access);
+}
+
+void RenderGraph::Pass::writeDepth(RGImage image, bool clear, float clearDepth)
+{
+    Access access = {image.index, true, true, uint32_t(ImageUsage::DepthAttachment), clear};
+    access.clearValue.depthStencil = {clearDepth, 0};
+    accesses.push_back(access);
+}
+
+void RenderGraph::Pass::read(RGImage image, ImageUsage usage)
+{
+    accesses.push_back({image.index, true, false, uint32_t(usage)});
+}
+
+void RenderGraph::Pass::write(RGImage image, ImageUsage usage)
+{
+    accesses.push_back({image.index, true, true, uint32_t(usage)});
+}
+
+void RenderGraph::Pass::read(RGBuffer buffer, BufferUsage usage)
+{
+    accesses.push_back({buffer.index, false, false, uint32_t(usage)});
+}
+
+void RenderGraph::Pass::write(RGBuffer buffer, BufferUsage usage)
+{
+    accesses.push_back({buffer.index, false, true, uint32_t(usage)});
+}
+
+void RenderGraph::Pass::setRenderingFlags(VkRenderingFlags flags)
+{
+    renderingFlags = flags;
+}
+
+void RenderGraph::Pass::setExecute(std::function<void(VkCommandBuffer cmd)> executeFunc)
+{
+    execute = std::move(executeFunc);
+}
+
+//
+// Graph
+//
+bool RenderGraph::TransientDesc::operator==(const TransientDesc &other) const
+{
+    return extent.width == other.extent.width && extent.height == other.extent.height && format == other.format &&
+        usage == other.usage && aspect == other.aspect && lazy == other.lazy && firstPass == other.firstPass && lastPass == other.lastPass;
+}
+
+void RenderGraph::init(VulkanGraphics &vulkanGraphics)
+{
+    graphics = &vulkanGraphics;
+    device = graphics->getDevice();
+    allocator = graphics->getAllocator();
+
+    // tile based gpus can keep attachments that are never stored in tile memory, without committing real memory
+    const VkPhysicalDeviceMemoryProperties *memoryProperties;
+    vmaGetMemoryProperties(allocator, &memoryProperties);
+    for (uint32_t i = 0; i < memoryProperties->memoryTypeCount; i++) {
+        if (memoryProperties->memoryTypes[i].propertyFlags & VK_MEMORY_PROPERTY_LAZILY_ALLOCATED_BIT)
+            lazyMemorySupported = true;
+    }
+
+    printf("Render graph transients: lazily allocated memory %s\n", lazyMemorySupported ? "supported" : "not supported");
+}
+
+void RenderGraph::shutdown()
+{
+    destroyTransients(transientImages, aliasGroups);
+    transientDescs.clear();
+}
+
+void RenderGraph::reset()
+{
+    resources.clear();
+    passes.clear();
+    transientResources.clear();
+}
+
+RGImage RenderGraph::importImage(const char *name, VkImage image, VkImageView view, VkExtent2D extent, VkImageAspectFlags aspect)
+{
+    auto it = imageStates.find(image);
+    return importImage(name, image, view, extent, aspect, it != imageStates.end() ? it->second : ResourceState());
+}
+
+RGImage RenderGraph::importImage(const char *name, VkImage image, VkImageView view, VkExtent2D extent, VkImageAspectFlags aspect, ResourceState initialState)
+{
+    Resource &resource = resources.emplace_back();
+    resource.name = name;
+    resource.image = true;
+    resource.handle = image;
+    resource.view = view;
+    resource.extent = extent;
+    resource.aspect = aspect;
+    resource.state = initialState;
+
+    return {static_cast<uint32_t>(resources.size() - 1)};
+}
+
+RGBuffer RenderGraph::importBuffer(const char *name, Buffer &buffer)
+{
+    Resource &resource = resources.emplace_back();
+    resource.name = name;
+    resource.image = false;
+    resource.buffer = buffer.buffer;
+
+    auto it = bufferStates.find(buffer.buffer);
+    if (it != bufferStates.end())
+        resource.state = it->second;
+
+    return {static_cast<uint32_t>(resources.size() - 1)};
+}
+
+RGImage RenderGraph::createImage(const char *name, VkExtent2D extent, VkFormat format, VkImageAspectFlags aspect)
+{
+    Resource &resource = resources.emplace_back();
+    resource.name = name;
+    resource.image = true;
+    resource.extent = extent;
+    resource.aspect = aspect;
+    resource.transient = true;
+    resource.format = format;
+
+    return {static_cast<uint32_t>(resources.size() - 1)};
+}
+
+void RenderGraph::setOutput(RGImage image, VkImageLayout finalLayout)
+{
+    // NOTE: transients don't outlive the frame, outputs have to be imported
+    assert(!resources[image.index].transient);
+    resources[image.index].output = true;
+    resources[image.index].finalLayout = finalLayout;
+}
+
+void RenderGraph::setOutput(RGBuffer buffer)
+{
+    resources[buffer.index].output = true;
+}
+
+RenderGraph::Pass &RenderGraph::addPass(const char *name, vec4 color)
+{
+    Pass &pass = passes.emplace_back();
+    pass.name = name;
+    pass.color = color;
+    return pass;
+}
+
+void RenderGraph::compile()
+{
+    // backwards: a pass is alive if it writes something that is needed later. Clearing writes end the need for older
+    // contents, loading writes and reads extend it. Store ops fall out of the same walk.
+    std::vector<bool> needed(resources.size());
+    for (size_t i = 0; i < resources.size(); i++)
+        needed[i] = resources[i].output;
+
+    culledPassCount = 0;
+    for (auto pass = passes.rbegin(); pass != passes.rend(); pass++) {
+        pass->culled = true;
+        for (auto &access : pass->accesses) {
+            if (access.write && needed[access.resource])
+                pass->culled = false;
+        }
+
+        if (pass->culled) {
+            culledPassCount++;
+            continue;
+        }
+
+        for (auto &access : pass->accesses) {
+            if (!access.write) continue;
+            access.storeOp = needed[access.resource] ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
+            needed[access.resource] = !access.clear;
+        }
+
+        for (auto &access : pass->accesses) {
+            if (!access.write)
+                needed[access.resource] = true;
+        }
+    }
+
+    // forwards: load only when something before actually left contents in the image
+    std::vector<bool> hasContents(resources.size());
+    for (size_t i = 0; i < resources.size(); i++)
+        hasContents[i] = !resources[i].image || resources[i].state.layout != VK_IMAGE_LAYOUT_UNDEFINED;
+
+    for (auto &pass : passes) {
+        if (pass.culled) continue;
+
+        for (auto &access : pass.accesses) {
+            if (!access.write) continue;
+
+            if (isAttachment(access.image, access.usage)) {
+                if (access.clear)
+                    access.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
+                else
+                    access.loadOp = hasContents[access.resource] ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_DONT_CARE;
+
+                hasContents[access.resource] = access.storeOp == VK_ATTACHMENT_STORE_OP_STORE;
+            } else {
+                hasContents[access.resource] = true;
+            }
+        }
+    }
+}
+
+void RenderGraph::realizeTransients()
+{
+    std::vector<TransientDesc> descs;
+    std::vector<uint32_t> descIndices(resources.size(), UINT32_MAX);
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        Resource &resource = resources[i];
+        if (!resource.transient) continue;
+
+        descIndices[i] = descs.size();
+        descs.push_back({resource.extent, resource.format, 0, resource.aspect, lazyMemorySupported, UINT32_MAX, 0});
+    }
+
+    // lifetimes in live pass order, usage flags from every live access
+    uint32_t passIndex = 0;
+    for (auto &pass : passes) {
+        if (pass.culled) continue;
+
+        for (auto &access : pass.accesses) {
+            if (!access.image || descIndices[access.resource] == UINT32_MAX) continue;
+
+            TransientDesc &desc = descs[descIndices[access.resource]];
+            desc.usage |= getImageUsageFlags(ImageUsage(access.usage));
+            desc.firstPass = std::min(desc.firstPass, passIndex);
+            desc.lastPass = std::max(desc.lastPass, passIndex);
+
+            // contents that leave the tile memory need real memory
+            if (!isAttachment(true, access.usage) || !access.write || access.storeOp == VK_ATTACHMENT_STORE_OP_STORE)
+                desc.lazy = false;
+        }
+        passIndex++;
+    }
+
+    // transients used only by culled passes get no image
+    std::vector<TransientDesc> liveDescs;
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        if (descIndices[i] == UINT32_MAX || descs[descIndices[i]].usage == 0) continue;
+
+        resources[i].transientIndex = liveDescs.size();
+        liveDescs.push_back(descs[descIndices[i]]);
+        transientResources.push_back(i);
+    }
+
+    if (liveDescs == transientDescs) {
+        for (uint32_t i = 0; i < transientResources.size(); i++) {
+            resources[transientResources[i]].handle = transientImages[i].handle;
+            resources[transientResources[i]].view = transientImages[i].view;
+        }
+        return;
+    }
+
+    // the frames in flight may still use the old images
+    if (!transientImages.empty() || !aliasGroups.empty()) {
+        graphics->destroyDeferred([this, images = std::move(transientImages), groups = std::move(aliasGroups)]() mutable {
+            destroyTransients(images, groups);
+        });
+        transientImages.clear();
+        aliasGroups.clear();
+    }
+
+    transientDescs = liveDescs;
+    transientImages.resize(liveDescs.size());
+    transientStats = {};
+    transientStats.imageCount = liveDescs.size();
+
+    std::vector<VkImageCreateInfo> imageInfos(liveDescs.size());
+    for (uint32_t i = 0; i < liveDescs.size(); i++) {
+        TransientDesc &desc = liveDescs[i];
+
+        VkImageCreateInfo &imageInfo = imageInfos[i];
+        imageInfo = {VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO};
+        imageInfo.imageType = VK_IMAGE_TYPE_2D;
+        imageInfo.format = desc.format;
+        imageInfo.extent = {desc.extent.width, desc.extent.height, 1};
+        imageInfo.mipLevels = 1;
+        imageInfo.arrayLayers = 1;
+        imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+        imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+        imageInfo.usage = desc.usage | (desc.lazy ? VK_IMAGE_USAGE_TRANSIENT_ATTACHMENT_BIT : 0);
+        imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    }
+
+    // greedy interval packing: in order of first use, every image goes into the first group whose last member is
+    // already dead and whose memory types are compatible
+    std::vector<uint32_t> order(liveDescs.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return liveDescs[a].firstPass < liveDescs[b].firstPass; });
+
+    for (uint32_t index : order) {
+        TransientDesc &desc = liveDescs[index];
+
+        VkDeviceImageMemoryRequirements requirementsInfo = {VK_STRUCTURE_TYPE_DEVICE_IMAGE_MEMORY_REQUIREMENTS};
+        requirementsInfo.pCreateInfo = &imageInfos[index];
+        VkMemoryRequirements2 requirements = {VK_STRUCTURE_TYPE_MEMORY_REQUIREMENTS_2};
+        vkGetDeviceImageMemoryRequirements(device, &requirementsInfo, &requirements);
+        VkMemoryRequirements &memory = requirements.memoryRequirements;
+
+        transientStats.requiredSize += memory.size;
+
+        uint32_t groupIndex = aliasGroups.size();
+        if (!desc.lazy) {
+            for (uint32_t i = 0; i < aliasGroups.size(); i++) {
+                AliasGroup &group = aliasGroups[i];
+                if (!group.lazy && group.lastPass < desc.firstPass && (group.requirements.memoryTypeBits & memory.memoryTypeBits)) {
+                    groupIndex = i;
+                    break;
+                }
+            }
+        }
+
+        if (groupIndex == aliasGroups.size()) {
+            AliasGroup &group = aliasGroups.emplace_back();
+            group.lazy = desc.lazy;
+            group.requirements = memory;
+        }
+
+        AliasGroup &group = aliasGroups[groupIndex];
+        group.requirements.size = std::max(group.requirements.size, memory.size);
+        group.requirements.alignment = std::max(group.requirements.alignment, memory.alignment);
+        group.requirements.memoryTypeBits &= memory.memoryTypeBits;
+        group.lastPass = desc.lastPass;
+        group.members.push_back(index);
+        transientImages[index].group = groupIndex;
+    }
+
+    for (auto &group : aliasGroups) {
+        if (group.lazy) {
+            uint32_t index = group.members[0];
+            TransientImage &image = transientImages[index];
+
+            VmaAllocationCreateInfo allocInfo = {};
+            allocInfo.usage = VMA_MEMORY_USAGE_GPU_LAZILY_ALLOCATED;
+            allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+            VK_CHECK(vmaCreateImage(allocator, &imageInfos[index], &allocInfo, &image.handle, &image.allocation, nullptr));
+
+            transientStats.lazyImageCount++;
+        } else {
+            VmaAllocationCreateInfo allocInfo = {};
+            allocInfo.flags = VMA_ALLOCATION_CREATE_DEDICATED_MEMORY_BIT;
+            allocInfo.requiredFlags = VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT;
+            VK_CHECK(vmaAllocateMemory(allocator, &group.requirements, &allocInfo, &group.allocation, nullptr));
+
+            for (uint32_t index : group.members)
+                VK_CHECK(vmaCreateAliasingImage(allocator, group.allocation, &imageInfos[index], &transientImages[index].handle));
+
+            transientStats.allocatedSize += group.requirements.size;
+            graphics->trackMemory(MemoryCategory::RenderTargets, group.requirements.size);
+        }
+
+        transientStats.allocationCount++;
+    }
+
+    for (uint32_t i = 0; i < liveDescs.size(); i++) {
+        VkImageViewCreateInfo imageViewInfo = {VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO};
+        imageViewInfo.image = transientImages[i].handle;
+        imageViewInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+        imageViewInfo.format = liveDescs[i].format;
+        imageViewInfo.subresourceRange = {liveDescs[i].aspect, 0, 1, 0, 1};
+        VK_CHECK(vkCreateImageView(device, &imageViewInfo, nullptr, &transientImages[i].view));
+
+        resources[transientResources[i]].handle = transientImages[i].handle;
+        resources[transientResources[i]].view = transientImages[i].view;
+    }
+}
+
+void RenderGraph::destroyTransients(std::vector<TransientImage> &images, std::vector<AliasGroup> &groups)
+{
+    for (auto &image : images) {
+        vkDestroyImageView(device, image.view, nullptr);
+        if (image.allocation)
+            vmaDestroyImage(allocator, image.handle, image.allocation);
+        else
+            vkDestroyImage(device, image.handle, nullptr);
+    }
+
+    for (auto &group : groups) {
+        if (!group.allocation) continue;
+
+        vmaFreeMemory(allocator, group.allocation);
+        graphics->trackMemory(MemoryCategory::RenderTargets, -int64_t(group.requirements.size));
+    }
+
+    images.clear();
+    groups.clear();
+}
+
+void RenderGraph::recordBarriers(VkCommandBuffer cmd, Pass &pass)
+{
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    std::vector<VkBufferMemoryBarrier> bufferBarriers;
+    VkPipelineStageFlags srcStages = 0;
+    VkPipelineStageFlags dstStages = 0;
+
+    for (auto &access : pass.accesses) {
+        Resource &resource = resources[access.resource];
+        ResourceState &state = resource.state;
+
+        // aliased memory has to wait for whatever the previous image in it (or in the previous frame) did last
+        if (resource.transient && resource.firstUse) {
+            resource.firstUse = false;
+
+            AliasGroup &group = aliasGroups[transientImages[resource.transientIndex].group];
+            auto member = std::find(group.members.begin(), group.members.end(), resource.transientIndex);
+            ResourceState previous = member == group.members.begin() ? group.state : resources[transientResources[*(member - 1)]].state;
+            state = {VK_IMAGE_LAYOUT_UNDEFINED, previous.writeStage | previous.readStages, previous.writeAccess};
+        }
+
+        UsageInfo usage = access.image ? getImageUsageInfo(ImageUsage(access.usage)) : getBufferUsageInfo(BufferUsage(access.usage));
+        bool attachment = isAttachment(access.image, access.usage);
+
+        VkAccessFlags dstAccess = usage.readAccess;
+        if (access.write) {
+            dstAccess = usage.writeAccess;
+            if (!attachment || access.loadOp == VK_ATTACHMENT_LOAD_OP_LOAD)
+                dstAccess |= usage.readAccess;
+        }
+
+        bool layoutChange = resource.image && state.layout != usage.layout;
+        bool hazard;
+        if (access.write) {
+            // write after write or after read
+            hazard = state.writeAccess != 0 || state.readStages != 0;
+        } else {
+            // read after write, unless an earlier reader at the same stages already waited for it
+            bool covered = (state.readStages & usage.stage) == usage.stage && (state.readAccess & dstAccess) == dstAccess;
+            hazard = state.writeAccess != 0 && !covered;
+        }
+
+        if (layoutChange || hazard) {
+            // a write waits for the readers as well, a read only for the write
+            srcStages |= state.writeStage;
+            if (access.write || layoutChange)
+                srcStages |= state.readStages;
+            dstStages |= usage.stage;
+
+            if (resource.image) {
+                // attachments that are cleared or don't care about contents can discard them in the transition
+                bool discard = attachment && access.loadOp != VK_ATTACHMENT_LOAD_OP_LOAD;
+
+                VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+                barrier.image = resource.handle;
+                barrier.srcAccessMask = state.writeAccess;
+                barrier.dstAccessMask = dstAccess;
+                barrier.oldLayout = discard ? VK_IMAGE_LAYOUT_UNDEFINED : state.layout;
+                barrier.newLayout = usage.layout;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+                imageBarriers.push_back(barrier);
+            } else {
+                VkBufferMemoryBarrier barrier = {VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER};
+                barrier.buffer = resource.buffer;
+                barrier.srcAccessMask = state.writeAccess;
+                barrier.dstAccessMask = dstAccess;
+                barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+                barrier.offset = 0;
+                barrier.size = VK_WHOLE_SIZE;
+                bufferBarriers.push_back(barrier);
+            }
+        }
+
+        if (access.write) {
+            state = {usage.layout, usage.stage, dstAccess & WRITE_ACCESS};
+        } else if (layoutChange) {
+            // the transition is a write of its own, readers at other stages wait for it along with the last write
+            state.layout = usage.layout;
+            state.writeStage |= usage.stage;
+            state.readStages = usage.stage;
+            state.readAccess = dstAccess;
+        } else {
+            // later writes have to wait for this reader too
+            state.readStages |= usage.stage;
+            state.readAccess |= dstAccess;
+        }
+    }
+
+    if (imageBarriers.empty() && bufferBarriers.empty()) return;
+
+    // all transitions of the pass in one call
+    vkCmdPipelineBarrier(cmd, srcStages, dstStages, 0, 0, nullptr, bufferBarriers.size(), bufferBarriers.data(), imageBarriers.size(), imageBarriers.data());
+    barrierCount += imageBarriers.size() + bufferBarriers.size();
+}
+
+void RenderGraph::recordOutputTransitions(VkCommandBuffer cmd)
+{
+    std::vector<VkImageMemoryBarrier> imageBarriers;
+    VkPipelineStageFlags srcStages = 0;
+
+    for (auto &resource : resources) {
+        if (!resource.image || !resource.output || resource.finalLayout == VK_IMAGE_LAYOUT_UNDEFINED) continue;
+        if (resource.state.layout == resource.finalLayout) continue;
+
+        srcStages |= resource.state.writeStage | resource.state.readStages;
+
+        VkImageMemoryBarrier barrier = {VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER};
+        barrier.image = resource.handle;
+        barrier.srcAccessMask = resource.state.writeAccess;
+        barrier.dstAccessMask = 0;
+        barrier.oldLayout = resource.state.layout;
+        barrier.newLayout = resource.finalLayout;
+        barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        barrier.subresourceRange = {resource.aspect, 0, VK_REMAINING_MIP_LEVELS, 0, VK_REMAINING_ARRAY_LAYERS};
+        imageBarriers.push_back(barrier);
+
+        // presentation (or readback) synchronizes through semaphores and fences, not through later barriers
+        resource.state = {resource.finalLayout, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0};
+    }
+
+    if (imageBarriers.empty()) return;
+
+    vkCmdPipelineBarrier(cmd, srcStages, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0, 0, nullptr, 0, nullptr, imageBarriers.size(), imageBarriers.data());
+    barrierCount += imageBarriers.size();
+}
+
+void RenderGraph::recordPass(VkCommandBuffer cmd, Pass &pass)
+{
+    recordBarriers(cmd, pass);
+
+    std::vector<VkRenderingAttachmentInfo> colorAttachments;
+    VkRenderingAttachmentInfo depthAttachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+    bool hasDepth = false;
+    VkExtent2D extent = {};
+
+    for (auto &access : pass.accesses) {
+        if (!isAttachment(access.image, access.usage)) continue;
+
+        Resource &resource = resources[access.resource];
+        extent = resource.extent;
+
+        VkRenderingAttachmentInfo attachment = {VK_STRUCTURE_TYPE_RENDERING_ATTACHMENT_INFO};
+        attachment.imageView = resource.view;
+        attachment.imageLayout = resource.state.layout;
+        attachment.loadOp = access.loadOp;
+        attachment.storeOp = access.storeOp;
+        attachment.clearValue = access.clearValue;
+
+        if (ImageUsage(access.usage) == ImageUsage::DepthAttachment) {
+            depthAttachment = attachment;
+            hasDepth = true;
+        } else {
+            colorAttachments.push_back(attachment);
+        }
+    }
+
+    if (colorAttachments.empty() && !hasDepth) {
+        if (pass.execute) pass.execute(cmd);
+        return;
+    }
+
+    VkRenderingInfo renderingInfo = {VK_STRUCTURE_TYPE_RENDERING_INFO};
+    renderingInfo.flags = pass.renderingFlags;
+    renderingInfo.colorAttachmentCount = colorAttachments.size();
+    renderingInfo.pColorAttachments = colorAttachments.data();
+    renderingInfo.pDepthAttachment = hasDepth ? &depthAttachment : nullptr;
+    renderingInfo.renderArea.extent = extent;
+    renderingInfo.renderArea.offset = {0};
+    renderingInfo.layerCount = 1;
+
+    vkCmdBeginRendering(cmd, &renderingInfo);
+
+    // secondary buffers don't inherit dynamic state, they set their own
+    if (!(pass.renderingFlags & VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT)) {
+        vkutils::setViewport(cmd, 0.0f, 0.0f, extent.width, extent.height);
+        vkutils::setScissor(cmd, extent);
+    }
+
+    if (pass.execute) pass.execute(cmd);
+
+    vkCmdEndRendering(cmd);
+}
+
+void RenderGraph::execute(VkCommandBuffer cmd, GpuProfiler *gpuProfiler)
+{
+    compile();
+    realizeTransients();
+    barrierCount = 0;
+
+    for (auto &pass : passes) {
+        if (pass.culled) continue;
+
+        profiler::beginZone(pass.name);
+        vkutils::beginDebugLabel(cmd, pass.name, pass.color);
+        if (gpuProfiler) gpuProfiler->beginScope(cmd, pass.name);
+
+        recordPass(cmd, pass);
+
+        if (gpuProfiler) gpuProfiler->endScope(cmd);
+        vkutils::endDebugLabel(cmd);
+        profiler::endZone();
+    }
+
+    recordOutputTransitions(cmd);
+
+    for (auto &group : aliasGroups)
+        group.state = resources[transientResources[group.members.back()]].state;
+
+    for (auto &resource : resources) {
+        if (resource.transient) continue;
+
+        if (resource.image)
+            imageStates[resource.handle] = resource.state;
+        else
+            bufferStates[resource.buffer] = resource.state;
+    }
+}
+
+void RenderGraph::drawImGui()
+{
+    ImGui::Text("Passes: %u (%u culled), barriers: %u", getPassCount(), culledPassCount, barrierCount);
+
+    // lazily allocated memory is committed by the driver on demand
+    transientStats.lazyCommittedSize = 0;
+    for (auto &image : transientImages) {
+        if (!image.allocation) continue;
+
+        VmaAllocationInfo info;
+        vmaGetAllocationInfo(allocator, image.allocation, &info);
+        VkDeviceSize committed = 0;
+        vkGetDeviceMemoryCommitment(device, info.deviceMemory, &committed);
+        transientStats.lazyCommittedSize += committed;
+    }
+
+    const double MB = 1024.0 * 1024.0;
+    VkDeviceSize usedSize = transientStats.allocatedSize + transientStats.lazyCommittedSize;
+    ImGui::Text("Transient images: %u in %u allocations (%u lazy)", transientStats.imageCount, transientStats.allocationCount, transientStats.lazyImageCount);
+    ImGui::Text("Transient memory: %.2f MB of %.2f MB, saved %.2f MB", usedSize / MB, transientStats.requiredSize / MB, (transientStats.requiredSize - std::min(usedSize, transientStats.requiredSize)) / MB);
+
+    for (auto &pass : passes) {
+        if (pass.culled) {
+            ImGui::TextDisabled("%s (culled)", pass.name);
+            continue;
+        }
+
+        ImGui::TextUnformatted(pass.name);
+        for (auto &access : pass.accesses) {
+            const char *resourceName = resources[access.resource].name.c_str();
+            if (isAttachment(access.image, access.usage))
+                ImGui::BulletText("%s: %s / %s", resourceName, getLoadOpName(access.loadOp), access.storeOp == VK_ATTACHMENT_STORE_OP_STORE ? "store" : "dont care");
+            else
+                ImGui::BulletText("%s: %s", resourceName, access.write ? "write" : "read");
+        }
+    }
+}
@@ -0,0 +1,243 @@
+#pragma once
+
+#include <revival/vulkan/common.h>
+#include <revival/vulkan/resources.h>
+#include <vk_mem_alloc.h>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class GpuProfiler;
+class VulkanGraphics;
+
+enum class ImageUsage
+{
+    ColorAttachment,
+    DepthAttachment,
+    SampledFragment,
+    SampledCompute,
+    StorageCompute,
+    TransferSrc,
+    TransferDst,
+};
+
+enum class BufferUsage
+{
+    IndexBuffer,
+    IndirectBuffer,
+    StorageGraphics,
+    StorageCompute,
+    TransferSrc,
+    TransferDst,
+};
+
+struct RGImage
+{
+    uint32_t index = UINT32_MAX;
+};
+
+struct RGBuffer
+{
+    uint32_t index = UINT32_MAX;
+};
+
+// Passes declare which images and buffers they read and write, the graph derives barriers, layout transitions and
+// attachment load/store ops from that and culls passes whose writes never reach an output.
+// It is rebuilt every frame, only the last known state of imported images and buffers is kept between frames.
+//
+// Transient images are owned by the graph and live only between their first and last use in a frame. Ones with disjoint
+// lifetimes share memory, attachments that are never stored use lazily allocated memory where the device has it.
+class RenderGraph
+{
+public:
+    struct ResourceState
+    {
+        VkImageLayout layout = VK_IMAGE_LAYOUT_UNDEFINED;
+        // last write (or layout transition), every later access has to depend on it
+        VkPipelineStageFlags writeStage = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+        VkAccessFlags writeAccess = 0;
+        // readers since the last write that already wait for it, the next write has to wait for them too
+        VkPipelineStageFlags readStages = 0;
+        VkAccessFlags readAccess = 0;
+    };
+
+    class Pass
+    {
+    public:
+        // attachments are bound in declaration order, clear sets the load op to clear, otherwise it is derived
+        void writeColor(RGImage image, bool clear = false, VkClearColorValue clearValue = {{0.0f, 0.0f, 0.0f, 1.0f}});
+        void writeDepth(RGImage image, bool clear = false, float clearDepth = 0.0f);
+
+        void read(RGImage image, ImageUsage usage = ImageUsage::SampledFragment);
+        void write(RGImage image, ImageUsage usage);
+        void read(RGBuffer buffer, BufferUsage usage);
+        void write(RGBuffer buffer, BufferUsage usage);
+
+        // VK_RENDERING_CONTENTS_SECONDARY_COMMAND_BUFFERS_BIT skips viewport/scissor setup, secondaries set their own
+        void setRenderingFlags(VkRenderingFlags flags);
+        // called inside vkCmdBeginRendering for passes with attachments, bare otherwise
+        void setExecute(std::function<void(VkCommandBuffer cmd)> execute);
+    private:
+        friend class RenderGraph;
+
+        struct Access
+        {
+            uint32_t resource;
+            bool image;
+            bool write;
+            uint32_t usage;
+            bool clear = false;
+            VkClearValue clearValue = {};
+
+            // derived by compile
+            VkAttachmentLoadOp loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+            VkAttachmentStoreOp storeOp = VK_ATTACHMENT_STORE_OP_STORE;
+        };
+
+        const char *name;
+        vec4 color;
+        std::vector<Access> accesses;
+        VkRenderingFlags renderingFlags = 0;
+        std::function<void(VkCommandBuffer cmd)> execute;
+        bool culled = false;
+    };
+
+    struct TransientStats
+    {
+        uint32_t imageCount = 0;
+        uint32_t allocationCount = 0;
+        uint32_t lazyImageCount = 0;
+        // bytes every transient would take with its own allocation
+        VkDeviceSize requiredSize = 0;
+        VkDeviceSize allocatedSize = 0;
+        // actually committed memory of lazily allocated images
+        VkDeviceSize lazyCommittedSize = 0;
+    };
+
+    void init(VulkanGraphics &vulkanGraphics);
+    // device has to be idle
+    void shutdown();
+
+    // clears passes and resources of the previous frame
+    void reset();
+
+    // imported resources start from the state they were left in by the last frame that used them.
+    // Images recreated under the same handle, or with contents that don't matter (swapchain after acquire), pass an explicit state.
+    RGImage importImage(const char *name, VkImage image, VkImageView view, VkExtent2D extent, VkImageAspectFlags aspect);
+    RGImage importImage(const char *name, VkImage image, VkImageView view, VkExtent2D extent, VkImageAspectFlags aspect, ResourceState initialState);
+    RGBuffer importBuffer(const char *name, Buffer &buffer);
+
+    // usage flags are derived from the passes that use the image, contents never survive the frame
+    RGImage createImage(const char *name, VkExtent2D extent, VkFormat format, VkImageAspectFlags aspect);
+    // valid inside pass execute, for descriptor writes of transient images
+    VkImageView getImageView(RGImage image) { return resources[image.index].view; };
+
+    // outputs keep their writers alive, images are transitioned to finalLayout at the end of the graph
+    void setOutput(RGImage image, VkImageLayout finalLayout);
+    void setOutput(RGBuffer buffer);
+
+    // name is also used for cpu profiler zones, so it has to outlive the profiler (string literal)
+    Pass &addPass(const char *name, vec4 color = {1.0, 1.0, 1.0, 1.0});
+
+    // culls passes, derives load/store ops and records every live pass with its barriers into cmd
+    void execute(VkCommandBuffer cmd, GpuProfiler *gpuProfiler = nullptr);
+
+    // stats of the last execute
+    uint32_t getPassCount() { return passes.size(); };
+    uint32_t getCulledPassCount() { return culledPassCount; };
+    uint32_t getBarrierCount() { return barrierCount; };
+    TransientStats &getTransientStats() { return transientStats; };
+
+    void drawImGui();
+private:
+    struct Resource
+    {
+        std::string name;
+        bool image;
+
+        VkImage handle = VK_NULL_HANDLE;
+        VkImageView view = VK_NULL_HANDLE;
+        VkExtent2D extent = {};
+        VkImageAspectFlags aspect = 0;
+
+        VkBuffer buffer = VK_NULL_HANDLE;
+
+        ResourceState state;
+        bool output = false;
+        VkImageLayout finalLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+        // transient images only
+        bool transient = false;
+        VkFormat format = VK_FORMAT_UNDEFINED;
+        uint32_t transientIndex = UINT32_MAX;
+        bool firstUse = true;
+    };
+
+    // description and lifetime (in live pass order) of a transient, equal lists between frames reuse the same images
+    struct TransientDesc
+    {
+        VkExtent2D extent;
+        VkFormat format;
+        VkImageUsageFlags usage;
+        VkImageAspectFlags aspect;
+        bool lazy;
+        uint32_t firstPass;
+        uint32_t lastPass;
+
+        bool operator==(const TransientDesc &other) const;
+    };
+
+    struct TransientImage
+    {
+        VkImage handle;
+        VkImageView view;
+        // own allocation of lazily allocated images, aliased ones are bound to their group memory
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        uint32_t group;
+    };
+
+    struct AliasGroup
+    {
+        // lazily allocated images are alone in their group, with their own allocation
+        bool lazy = false;
+        VmaAllocation allocation = VK_NULL_HANDLE;
+        VkMemoryRequirements requirements = {};
+        uint32_t lastPass = 0;
+        // transient indices in lifetime order, every member starts with the state the previous one left the memory in
+        std::vector<uint32_t> members;
+        // state of the memory at the end of the last frame
+        ResourceState state;
+    };
+
+    void compile();
+    void realizeTransients();
+    void destroyTransients(std::vector<TransientImage> &images, std::vector<AliasGroup> &groups);
+    void recordBarriers(VkCommandBuffer cmd, Pass &pass);
+    void recordOutputTransitions(VkCommandBuffer cmd);
+    void recordPass(VkCommandBuffer cmd, Pass &pass);
+
+    std::vector<Resource> resources;
+    // deque keeps references returned by addPass valid
+    std::deque<Pass> passes;
+
+    // state of imported resources at the end of the last frame that used them
+    std::unordered_map<VkImage, ResourceState> imageStates;
+    std::unordered_map<VkBuffer, ResourceState> bufferStates;
+
+    uint32_t culledPassCount = 0;
+    uint32_t barrierCount = 0;
+
+    VulkanGraphics *graphics = nullptr;
+    VkDevice device = VK_NULL_HANDLE;
+    VmaAllocator allocator = VK_NULL_HANDLE;
+    bool lazyMemorySupported = false;
+
+    std::vector<TransientDesc> transientDescs;
+    std::vector<TransientImage> transientImages;
+    std::vector<AliasGroup> aliasGroups;
+    // resource index of every transient in this frame
+    std::vector<uint32_t> transientResources;
+    TransientStats transientStats;
+};
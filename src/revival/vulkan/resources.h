@@ -3,6 +3,7 @@
 #include <volk.h>
 #include <vk_mem_alloc.h>
 #include <stb_image.h>
+#include <string.h>
 
 struct Buffer
 {
@@ -13,10 +14,57 @@ struct Buffer
     VkDeviceAddress address;
 };
 
+// full sampler state, equal descriptions share one VkSampler
+struct SamplerDesc
+{
+    VkFilter minFilter = VK_FILTER_LINEAR;
+    VkFilter magFilter = VK_FILTER_LINEAR;
+    VkSamplerMipmapMode mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    VkSamplerAddressMode addressMode = VK_SAMPLER_ADDRESS_MODE_REPEAT;
+    // 1 disables anisotropic filtering, clamped to the device limit
+    float maxAnisotropy = 1.0f;
+    float minLod = 0.0f;
+    float maxLod = VK_LOD_CLAMP_NONE;
+    VkBool32 compareEnable = VK_FALSE;
+    VkCompareOp compareOp = VK_COMPARE_OP_NEVER;
+    VkBorderColor borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+
+    bool operator==(const SamplerDesc &other) const
+    {
+        return minFilter == other.minFilter && magFilter == other.magFilter && mipmapMode == other.mipmapMode &&
+            addressMode == other.addressMode && maxAnisotropy == other.maxAnisotropy && minLod == other.minLod &&
+            maxLod == other.maxLod && compareEnable == other.compareEnable && compareOp == other.compareOp && borderColor == other.borderColor;
+    }
+};
+
+struct SamplerDescHash
+{
+    size_t operator()(const SamplerDesc &desc) const
+    {
+        // FNV-1a over the fields
+        size_t hash = 2166136261u;
+        auto add = [&](uint32_t value) { hash = (hash ^ value) * 16777619u; };
+        auto addFloat = [&](float value) { uint32_t bits; memcpy(&bits, &value, sizeof(bits)); add(bits); };
+
+        add(desc.minFilter);
+        add(desc.magFilter);
+        add(desc.mipmapMode);
+        add(desc.addressMode);
+        addFloat(desc.maxAnisotropy);
+        addFloat(desc.minLod);
+        addFloat(desc.maxLod);
+        add(desc.compareEnable);
+        add(desc.compareOp);
+        add(desc.borderColor);
+        return hash;
+    }
+};
+
 struct Image
 {
     VkImage handle;
     VkImageView view;
+    // shared, owned by the sampler cache of VulkanGraphics
     VkSampler sampler;
 
     VmaAllocation allocation;
@@ -44,4 +92,6 @@ struct Texture
 {
     Image image;
     TextureInfo info;
+    // slot in the bindless texture table, cubemaps are not in it
+    uint32_t slot = UINT32_MAX;
 };
@@ -0,0 +1,147 @@
+#include <revival/vulkan/texture_registry.h>
+#include <revival/vulkan/graphics.h>
+#include <revival/vulkan/utils.h>
+#include <algorithm>
+
+void TextureRegistry::init(VulkanGraphics &vulkanGraphics, uint32_t initialCapacity, uint32_t maxTextures)
+{
+    graphics = &vulkanGraphics;
+    device = graphics->getDevice();
+
+    VkPhysicalDeviceVulkan12Properties properties12 = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES};
+    VkPhysicalDeviceProperties2 properties = {VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
+    properties.pNext = &properties12;
+    vkGetPhysicalDeviceProperties2(graphics->getPhysicalDevice(), &properties);
+
+    maxCapacity = std::min({maxTextures, properties12.maxDescriptorSetUpdateAfterBindSampledImages, properties12.maxPerStageDescriptorUpdateAfterBindSampledImages});
+
+    // the layout is sized for the maximum, every set allocates only its current capacity of it.
+    // Unwritten slots are never sampled, written ones are only rewritten once no frame in flight uses them
+    std::vector<VkDescriptorSetLayoutBinding> bindings = {
+        {0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, maxCapacity, VK_SHADER_STAGE_FRAGMENT_BIT}, // textures
+    };
+    VkDescriptorBindingFlags bindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
+                                            VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT;
+
+    setLayout = vkutils::createDescriptorSetLayout(device, bindings.data(), bindings.size(), &bindingFlags);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    grow(std::min(initialCapacity, maxCapacity));
+
+    printf("Bindless texture table: %u slots (up to %u)\n", capacity, maxCapacity);
+}
+
+void TextureRegistry::shutdown()
+{
+    vkDestroyDescriptorPool(device, pool, nullptr);
+    vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+}
+
+bool TextureRegistry::grow(uint32_t newCapacity)
+{
+    if (newCapacity <= capacity) return false;
+
+    std::vector<VkDescriptorPoolSize> poolSizes = {
+        {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, newCapacity},
+    };
+    VkDescriptorPool newPool = vkutils::createDescriptorPool(device, poolSizes, VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT);
+
+    VkDescriptorSetVariableDescriptorCountAllocateInfo countInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO};
+    countInfo.descriptorSetCount = 1;
+    countInfo.pDescriptorCounts = &newCapacity;
+
+    VkDescriptorSetAllocateInfo allocateInfo = {VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO};
+    allocateInfo.pNext = &countInfo;
+    allocateInfo.descriptorPool = newPool;
+    allocateInfo.descriptorSetCount = 1;
+    allocateInfo.pSetLayouts = &setLayout;
+
+    VkDescriptorSet newSet;
+    VK_CHECK(vkAllocateDescriptorSets(device, &allocateInfo, &newSet));
+    vkutils::setDebugName(device, (uint64_t)newSet, VK_OBJECT_TYPE_DESCRIPTOR_SET, "bindless textures");
+
+    // runs of live slots, released ones may point at destroyed images and are never sampled again
+    std::vector<VkCopyDescriptorSet> copies;
+    for (uint32_t slot = 0; slot < nextSlot; slot++) {
+        if (!liveSlots[slot]) continue;
+
+        if (!copies.empty() && copies.back().srcArrayElement + copies.back().descriptorCount == slot) {
+            copies.back().descriptorCount++;
+            continue;
+        }
+
+        VkCopyDescriptorSet copy = {VK_STRUCTURE_TYPE_COPY_DESCRIPTOR_SET};
+        copy.srcSet = set;
+        copy.srcBinding = 0;
+        copy.srcArrayElement = slot;
+        copy.dstSet = newSet;
+        copy.dstBinding = 0;
+        copy.dstArrayElement = slot;
+        copy.descriptorCount = 1;
+        copies.push_back(copy);
+    }
+    if (!copies.empty())
+        vkUpdateDescriptorSets(device, 0, nullptr, copies.size(), copies.data());
+
+    // frames in flight may have bound the old set
+    if (pool != VK_NULL_HANDLE) {
+        graphics->destroyDeferred([device = device, oldPool = pool]() {
+            vkDestroyDescriptorPool(device, oldPool, nullptr);
+        });
+    }
+
+    pool = newPool;
+    set = newSet;
+    capacity = newCapacity;
+    liveSlots.resize(capacity, false);
+
+    return true;
+}
+
+uint32_t TextureRegistry::add(VkImageView view, VkSampler sampler, VkImageLayout layout)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    uint32_t slot;
+    if (!freeSlots.empty()) {
+        slot = freeSlots.back();
+        freeSlots.pop_back();
+    } else {
+        if (nextSlot == capacity && !grow(std::min(capacity * 2, maxCapacity))) {
+            printf("Bindless texture table is full (%u slots), texture is not registered.\n", capacity);
+            return UINT32_MAX;
+        }
+        slot = nextSlot++;
+    }
+    count++;
+    liveSlots[slot] = true;
+
+    VkDescriptorImageInfo imageInfo = {sampler, view, layout};
+
+    VkWriteDescriptorSet write = {VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET};
+    write.dstSet = set;
+    write.dstBinding = 0;
+    write.dstArrayElement = slot;
+    write.descriptorCount = 1;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = &imageInfo;
+    vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+    return slot;
+}
+
+void TextureRegistry::remove(uint32_t slot)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    assert(slot < nextSlot);
+
+    // not copied if the table grows in the meantime, frames recorded from now on don't sample it
+    liveSlots[slot] = false;
+
+    // frames in flight may still sample the slot, it is handed out again only after they finished
+    graphics->destroyDeferred([this, slot]() {
+        std::lock_guard<std::mutex> lock(mutex);
+        freeSlots.push_back(slot);
+        count--;
+    });
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <revival/vulkan/common.h>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+class VulkanGraphics;
+
+// slots allocated up front, the table doubles when they run out
+const uint32_t INITIAL_BINDLESS_TEXTURES = 1024;
+// upper bound of the table, clamped to the update after bind limits of the device
+const uint32_t MAX_BINDLESS_TEXTURES = 16384;
+
+// Global bindless table of sampled 2D textures, bound as set 1 (binding 0) by every pass that samples textures.
+// Slots are stable for the lifetime of a texture. Removed slots are reused only after the frames in flight that
+// could still sample them have finished, so adding or removing a texture at runtime is a single descriptor write.
+//
+// The binding has a variable descriptor count, so growing reallocates the set with more slots under the same layout
+// and pipelines stay valid. The old set lives on until the frames in flight that bound it have finished.
+class TextureRegistry
+{
+public:
+    void init(VulkanGraphics &graphics, uint32_t initialCapacity = INITIAL_BINDLESS_TEXTURES, uint32_t maxCapacity = MAX_BINDLESS_TEXTURES);
+    // device has to be idle
+    void shutdown();
+
+    // UINT32_MAX when the table is at its maximum capacity
+    uint32_t add(VkImageView view, VkSampler sampler, VkImageLayout layout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+    // NOTE: the image itself has to outlive the frames in flight as well
+    void remove(uint32_t slot);
+
+    VkDescriptorSetLayout getSetLayout() { return setLayout; };
+    // changes when the table grows, bind it again every frame
+    VkDescriptorSet getSet() { return set; };
+    uint32_t getCapacity() { return capacity; };
+    uint32_t getMaxCapacity() { return maxCapacity; };
+    uint32_t getCount() { return count; };
+private:
+    // allocates pool and set with newCapacity slots and copies the live ones over, mutex has to be held
+    bool grow(uint32_t newCapacity);
+
+    VulkanGraphics *graphics;
+    VkDevice device;
+
+    VkDescriptorPool pool = VK_NULL_HANDLE;
+    VkDescriptorSetLayout setLayout;
+    // replaced by grow while passes may be binding it
+    std::atomic<VkDescriptorSet> set = VK_NULL_HANDLE;
+
+    uint32_t capacity = 0;
+    uint32_t maxCapacity = 0;
+    uint32_t count = 0;
+    // slots from nextSlot on were never used, freeSlots were released and are reused first
+    uint32_t nextSlot = 0;
+    std::vector<uint32_t> freeSlots;
+    // slots with a texture, only these are copied on grow
+    std::vector<bool> liveSlots;
+
+    // textures are loaded from jobs too
+    std::mutex mutex;
+};
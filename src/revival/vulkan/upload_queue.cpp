@@ -0,0 +1,265 @@
+#include <revival/vulkan/upload_queue.h>
+#include <revival/vulkan/graphics.h>
+#include <revival/vulkan/utils.h>
+#include <string.h>
+
+// covers optimalBufferCopyOffsetAlignment and texel size of every format we upload
+const VkDeviceSize STAGING_ALIGNMENT = 256;
+
+static VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment)
+{
+    return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void UploadQueue::init(VulkanGraphics &graphics, uint32_t queueFamilyIndex, VkQueue queue, VkDeviceSize ringSize)
+{
+    this->graphics = &graphics;
+    this->device = graphics.getDevice();
+    this->queue = queue;
+
+    VkCommandPoolCreateInfo commandPoolInfo = {VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO};
+    commandPoolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT | VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+    commandPoolInfo.queueFamilyIndex = queueFamilyIndex;
+    VK_CHECK(vkCreateCommandPool(device, &commandPoolInfo, nullptr, &commandPool));
+
+    semaphore = vkutils::createTimelineSemaphore(device, 0);
+    vkutils::setDebugName(device, (uint64_t)semaphore, VK_OBJECT_TYPE_SEMAPHORE, "upload timeline");
+
+    graphics.createBuffer(ring, ringSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryClass::Staging);
+    vkutils::setDebugName(device, (uint64_t)ring.buffer, VK_OBJECT_TYPE_BUFFER, "staging ring");
+}
+
+void UploadQueue::shutdown()
+{
+    // NOTE: device should be idle at this point
+    for (auto &[buffer, value] : dedicatedStaging)
+        graphics->destroyBuffer(buffer);
+
+    dedicatedStaging.clear();
+    regions.clear();
+
+    graphics->destroyBuffer(ring);
+    vkDestroySemaphore(device, semaphore, nullptr);
+    vkDestroyCommandPool(device, commandPool, nullptr);
+}
+
+UploadToken UploadQueue::uploadBuffer(Buffer &buffer, const void *data, VkDeviceSize size, VkDeviceSize dstOffset)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (size == 0)
+        return {submittedValue};
+
+    Staging staging = allocateStaging(size);
+    memcpy(staging.mapped, data, size);
+    VK_CHECK(vmaFlushAllocation(graphics->getAllocator(), staging.allocation, staging.offset, size));
+
+    VkBufferCopy copyRegion = {staging.offset, dstOffset, size};
+    vkCmdCopyBuffer(getCommandBuffer(), staging.buffer, buffer.buffer, 1, &copyRegion);
+
+    return {submittedValue + 1};
+}
+
+UploadToken UploadQueue::uploadImage(Image &image, const void *data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t layerCount, VkImageAspectFlags aspect)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (size == 0)
+        return {submittedValue};
+
+    Staging staging = allocateStaging(size);
+    memcpy(staging.mapped, data, size);
+    VK_CHECK(vmaFlushAllocation(graphics->getAllocator(), staging.allocation, staging.offset, size));
+
+    VkCommandBuffer cmd = getCommandBuffer();
+
+    // transition image to transfer
+    vkutils::insertImageBarrier(
+        cmd, image.handle,
+        0, VK_ACCESS_TRANSFER_WRITE_BIT,
+        VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+        VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+        {aspect, 0, 1, 0, layerCount});
+
+    // copy
+    VkDeviceSize layerSize = size / layerCount;
+    std::vector<VkBufferImageCopy> copyRegions(layerCount);
+    for (uint32_t layer = 0; layer < layerCount; layer++) {
+        copyRegions[layer] = {};
+        copyRegions[layer].bufferOffset = staging.offset + layer * layerSize;
+        copyRegions[layer].imageSubresource = {aspect, 0, layer, 1};
+        copyRegions[layer].imageExtent = {width, height, 1};
+    }
+
+    vkCmdCopyBufferToImage(cmd, staging.buffer, image.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, copyRegions.size(), copyRegions.data());
+
+    // transition image to shader read, the graphics queue waits on the timeline semaphore before it samples it.
+    // NOTE: transfer only queues don't support shader stages, so the destination scope is left to the semaphore.
+    vkutils::insertImageBarrier(
+        cmd, image.handle,
+        VK_ACCESS_TRANSFER_WRITE_BIT, 0,
+        VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+        VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+        {aspect, 0, 1, 0, layerCount});
+
+    return {submittedValue + 1};
+}
+
+UploadToken UploadQueue::flush()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return submit();
+}
+
+bool UploadQueue::isComplete(UploadToken token)
+{
+    return getCompletedValue() >= token.value;
+}
+
+void UploadQueue::wait(UploadToken token)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (token.value > submittedValue)
+            submit();
+    }
+
+    waitValue(token.value);
+}
+
+UploadToken UploadQueue::submit()
+{
+    if (recording == VK_NULL_HANDLE)
+        return {submittedValue};
+
+    VK_CHECK(vkEndCommandBuffer(recording));
+
+    uint64_t signalValue = submittedValue + 1;
+
+    VkTimelineSemaphoreSubmitInfo timelineInfo = {VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO};
+    timelineInfo.signalSemaphoreValueCount = 1;
+    timelineInfo.pSignalSemaphoreValues = &signalValue;
+
+    VkSubmitInfo submit = {VK_STRUCTURE_TYPE_SUBMIT_INFO};
+    submit.pNext = &timelineInfo;
+    submit.commandBufferCount = 1;
+    submit.pCommandBuffers = &recording;
+    submit.signalSemaphoreCount = 1;
+    submit.pSignalSemaphores = &semaphore;
+    VK_CHECK(vkQueueSubmit(queue, 1, &submit, VK_NULL_HANDLE));
+
+    pendingCommandBuffers.push_back({recording, signalValue});
+    recording = VK_NULL_HANDLE;
+    submittedValue = signalValue;
+
+    return {signalValue};
+}
+
+UploadQueue::Staging UploadQueue::allocateStaging(VkDeviceSize size)
+{
+    // too big for the ring
+    if (size > ring.size) {
+        Buffer buffer;
+        graphics->createBuffer(buffer, size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, MemoryClass::Staging);
+        dedicatedStaging.push_back({buffer, submittedValue + 1});
+
+        return {buffer.buffer, 0, buffer.info.pMappedData, buffer.allocation};
+    }
+
+    while (true) {
+        reclaim();
+
+        VkDeviceSize offset = 0;
+        bool found = false;
+
+        if (regions.empty()) {
+            found = true;
+        } else if (regions.back().begin >= regions.front().begin) {
+            // [front.begin, back.end) is in use
+            offset = alignUp(regions.back().end, STAGING_ALIGNMENT);
+            if (offset + size <= ring.size) {
+                found = true;
+            } else if (size <= regions.front().begin) {
+                offset = 0;
+                found = true;
+            }
+        } else {
+            // wrapped, [front.begin, ring end) and [0, back.end) are in use
+            offset = alignUp(regions.back().end, STAGING_ALIGNMENT);
+            found = offset + size <= regions.front().begin;
+        }
+
+        if (found) {
+            regions.push_back({offset, offset + size, submittedValue + 1});
+            return {ring.buffer, offset, static_cast<unsigned char*>(ring.info.pMappedData) + offset, ring.allocation};
+        }
+
+        // ring is full, wait for the oldest batch to finish
+        uint64_t oldest = regions.front().value;
+        if (oldest > submittedValue)
+            submit();
+
+        waitValue(oldest);
+    }
+}
+
+VkCommandBuffer UploadQueue::getCommandBuffer()
+{
+    if (recording != VK_NULL_HANDLE)
+        return recording;
+
+    reclaim();
+
+    if (freeCommandBuffers.size() > 0) {
+        recording = freeCommandBuffers.back();
+        freeCommandBuffers.pop_back();
+        VK_CHECK(vkResetCommandBuffer(recording, 0));
+    } else {
+        VkCommandBufferAllocateInfo bufferAllocInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO};
+        bufferAllocInfo.commandPool = commandPool;
+        bufferAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+        bufferAllocInfo.commandBufferCount = 1;
+        VK_CHECK(vkAllocateCommandBuffers(device, &bufferAllocInfo, &recording));
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO};
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    VK_CHECK(vkBeginCommandBuffer(recording, &beginInfo));
+
+    return recording;
+}
+
+void UploadQueue::reclaim()
+{
+    uint64_t completed = getCompletedValue();
+
+    while (!regions.empty() && regions.front().value <= completed) {
+        regions.pop_front();
+    }
+
+    while (!dedicatedStaging.empty() && dedicatedStaging.front().second <= completed) {
+        graphics->destroyBuffer(dedicatedStaging.front().first);
+        dedicatedStaging.pop_front();
+    }
+
+    while (!pendingCommandBuffers.empty() && pendingCommandBuffers.front().second <= completed) {
+        freeCommandBuffers.push_back(pendingCommandBuffers.front().first);
+        pendingCommandBuffers.pop_front();
+    }
+}
+
+uint64_t UploadQueue::getCompletedValue()
+{
+    uint64_t value = 0;
+    VK_CHECK(vkGetSemaphoreCounterValue(device, semaphore, &value));
+    return value;
+}
+
+void UploadQueue::waitValue(uint64_t value)
+{
+    VkSemaphoreWaitInfo waitInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO};
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &semaphore;
+    waitInfo.pValues = &value;
+    VK_CHECK(vkWaitSemaphores(device, &waitInfo, ~0ull));
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <revival/vulkan/common.h>
+#include <revival/vulkan/resources.h>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+class VulkanGraphics;
+
+// Completion handle of an upload. It holds the value that the upload timeline semaphore reaches when the copy is done.
+struct UploadToken
+{
+    uint64_t value = 0;
+};
+
+// Records buffer/image copies from a persistently mapped staging ring into batches and submits them
+// to the transfer queue. Completion is tracked with a timeline semaphore instead of fences.
+class UploadQueue
+{
+public:
+    void init(VulkanGraphics &graphics, uint32_t queueFamilyIndex, VkQueue queue, VkDeviceSize ringSize = 64 * 1024 * 1024);
+    void shutdown();
+
+    UploadToken uploadBuffer(Buffer &buffer, const void *data, VkDeviceSize size, VkDeviceSize dstOffset = 0);
+    // data should contain layerCount tightly packed layers
+    UploadToken uploadImage(Image &image, const void *data, VkDeviceSize size, uint32_t width, uint32_t height, uint32_t layerCount = 1, VkImageAspectFlags aspect = VK_IMAGE_ASPECT_COLOR_BIT);
+
+    // submit all recorded copies as one batch
+    UploadToken flush();
+
+    bool isComplete(UploadToken token);
+    void wait(UploadToken token);
+
+    VkSemaphore getSemaphore() { return semaphore; };
+    uint64_t getSubmittedValue() { return submittedValue; };
+private:
+    struct Staging
+    {
+        VkBuffer buffer;
+        VkDeviceSize offset;
+        void *mapped;
+        VmaAllocation allocation;
+    };
+
+    // NOTE: private functions expect the mutex to be locked
+    UploadToken submit();
+    Staging allocateStaging(VkDeviceSize size);
+    VkCommandBuffer getCommandBuffer();
+    void reclaim();
+    uint64_t getCompletedValue();
+    void waitValue(uint64_t value);
+
+    VulkanGraphics *graphics;
+    VkDevice device;
+    VkQueue queue;
+
+    VkCommandPool commandPool;
+    VkCommandBuffer recording = VK_NULL_HANDLE;
+    std::deque<std::pair<VkCommandBuffer, uint64_t>> pendingCommandBuffers;
+    std::vector<VkCommandBuffer> freeCommandBuffers;
+
+    VkSemaphore semaphore;
+    uint64_t submittedValue = 0;
+
+    // ring allocator, regions are kept in allocation order together with the value of the batch that reads them
+    struct Region
+    {
+        VkDeviceSize begin;
+        VkDeviceSize end;
+        uint64_t value;
+    };
+    Buffer ring;
+    std::deque<Region> regions;
+
+    // uploads that don't fit into the ring get their own staging buffer
+    std::deque<std::pair<Buffer, uint64_t>> dedicatedStaging;
+
+    std::mutex mutex;
+};
@@ -13,6 +13,21 @@ namespace vkutils
         return semaphore;
     }
 
+    VkSemaphore createTimelineSemaphore(VkDevice device, uint64_t initialValue)
+    {
+        VkSemaphoreTypeCreateInfo typeInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO};
+        typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+        typeInfo.initialValue = initialValue;
+
+        VkSemaphoreCreateInfo createInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO};
+        createInfo.pNext = &typeInfo;
+
+        VkSemaphore semaphore;
+        VK_CHECK(vkCreateSemaphore(device, &createInfo, nullptr, &semaphore));
+
+        return semaphore;
+    }
+
     VkFence createFence(VkDevice device, VkFenceCreateFlags flags)
     {
         VkFenceCreateInfo createInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO};
@@ -142,12 +157,15 @@ namespace vkutils
     }
 
     VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *setLayout, VkPushConstantRange *pushConstant)
+    {
+        return createPipelineLayout(device, setLayout, setLayout ? 1 : 0, pushConstant);
+    }
+
+    VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *setLayouts, uint32_t setLayoutCount, VkPushConstantRange *pushConstant)
     {
         VkPipelineLayoutCreateInfo layoutInfo = {VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO};
-        if (setLayout) {
-            layoutInfo.setLayoutCount = 1;
-            layoutInfo.pSetLayouts = setLayout;
-        }
+        layoutInfo.setLayoutCount = setLayoutCount;
+        layoutInfo.pSetLayouts = setLayouts;
         if (pushConstant) {
             layoutInfo.pushConstantRangeCount = 1;
             layoutInfo.pPushConstantRanges = pushConstant;
@@ -6,6 +6,7 @@ namespace vkutils
 {
     // primitive
     VkSemaphore createSemaphore(VkDevice device);
+    VkSemaphore createTimelineSemaphore(VkDevice device, uint64_t initialValue);
     VkFence createFence(VkDevice device, VkFenceCreateFlags flags);
 
     // barrier
@@ -21,6 +22,7 @@ namespace vkutils
 
     // pipeline
     VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *setLayout, VkPushConstantRange *pushConstant);
+    VkPipelineLayout createPipelineLayout(VkDevice device, VkDescriptorSetLayout *setLayouts, uint32_t setLayoutCount, VkPushConstantRange *pushConstant);
     VkShaderModule loadShaderModule(VkDevice device, const char *path);
 
     void setDebugName(VkDevice device, uint64_t objectHandle, VkObjectType objectType, const char *name);